@@ -0,0 +1,195 @@
+/*
+ * Stackless coroutine test
+ *
+ * Run many coroutines yielding to each other, a coroutine exchanging values
+ * with a thread through semaphores, and a coroutine waiting on a condition set
+ * by a thread. Then check coroutines left waiting at the end of a run do not
+ * get in the way of the next one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <coro.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define NR_COROS 10000
+#define NR_YIELDS 3
+#define NR_ROUNDS 100
+
+/*
+ * Many coroutines
+ */
+struct counter
+{
+	struct coro co;
+	int i;
+};
+
+static unsigned long nr_steps;
+static unsigned long nr_exited;
+
+static int count(struct coro *co)
+{
+	struct counter *c = (struct counter *)co;
+
+	CORO_BEGIN(co);
+	for (c->i = 0; c->i < NR_YIELDS; c->i++)
+	{
+		nr_steps++;
+		CORO_YIELD(co);
+	}
+	CORO_END(co);
+}
+
+static void counter_exit(struct coro *co)
+{
+	nr_exited++;
+	free(co);
+}
+
+static void spawn_counters(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < NR_COROS; i++)
+	{
+		struct counter *c = malloc(sizeof(*c));
+
+		if (!c || coro_spawn(&c->co, count, counter_exit))
+			exit(1);
+	}
+}
+
+/*
+ * Ping-pong with a thread
+ */
+struct ponger
+{
+	struct coro co;
+	sem_t ping, pong;
+	int rounds;
+};
+
+static int value;
+static int nr_mismatches;
+
+static int pong(struct coro *co)
+{
+	struct ponger *p = (struct ponger *)co;
+
+	CORO_BEGIN(co);
+	for (p->rounds = 0; p->rounds < NR_ROUNDS; p->rounds++)
+	{
+		CORO_SEM_DOWN(co, p->ping);
+		if (value != 2 * p->rounds + 1)
+			nr_mismatches++;
+		value++;
+		sem_up(p->pong);
+	}
+	CORO_END(co);
+}
+
+static void ping(void *arg)
+{
+	struct ponger *p = arg;
+
+	coro_spawn(&p->co, pong, NULL);
+	for (int i = 0; i < NR_ROUNDS; i++)
+	{
+		value++;
+		sem_up(p->ping);
+		sem_down(p->pong);
+		if (value != 2 * i + 2)
+			nr_mismatches++;
+	}
+}
+
+/*
+ * Waiting on a condition
+ */
+static int flag;
+static int flag_seen;
+
+static int wait_flag(struct coro *co)
+{
+	CORO_BEGIN(co);
+	CORO_WAIT_UNTIL(co, flag);
+	flag_seen = 1;
+	CORO_END(co);
+}
+
+static void set_flag(void *arg)
+{
+	static struct coro co;
+	(void)arg;
+
+	coro_spawn(&co, wait_flag, NULL);
+	for (int i = 0; i < 10; i++)
+		uthread_yield();
+	TEST_ASSERT(flag_seen == 0);
+	flag = 1;
+}
+
+/*
+ * Left waiting
+ */
+static int wait_forever(struct coro *co)
+{
+	CORO_BEGIN(co);
+	CORO_SEM_DOWN(co, ((struct ponger *)co)->ping);
+	CORO_END(co);
+}
+
+static void abandon(void *arg)
+{
+	coro_spawn(arg, wait_forever, NULL);
+}
+
+int main(void)
+{
+	struct ponger p = {.ping = sem_create(0), .pong = sem_create(0)};
+	struct ponger forgotten = {.ping = sem_create(0)};
+	struct coro co;
+
+	TEST_ASSERT(coro_spawn(&co, count, NULL) == -1);
+
+	uthread_run(false, spawn_counters, NULL);
+	TEST_ASSERT(nr_steps == NR_COROS * NR_YIELDS);
+	TEST_ASSERT(nr_exited == NR_COROS);
+
+	uthread_run(false, ping, &p);
+	TEST_ASSERT(p.rounds == NR_ROUNDS);
+	TEST_ASSERT(value == 2 * NR_ROUNDS);
+	TEST_ASSERT(nr_mismatches == 0);
+
+	uthread_run(false, set_flag, NULL);
+	TEST_ASSERT(flag_seen == 1);
+
+	uthread_run(false, abandon, &forgotten);
+	flag = 0;
+	flag_seen = 0;
+	uthread_run(false, set_flag, NULL);
+	TEST_ASSERT(flag_seen == 1);
+
+	sem_destroy(p.ping);
+	sem_destroy(p.pong);
+
+	return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Sieve for finding prime numbers, with generators
+ *
+ * Same pipeline as sem_prime.c, where each stage is a generator consuming the
+ * values of the previous one: a source generator produces all numbers, and a
+ * filtering generator is added at the end of the pipeline each time a new
+ * prime number comes out of it.
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gen.h>
+#include <uthread.h>
+
+#define MAXPRIME 1000
+
+struct filter
+{
+	gen_t left;
+	gen_t self;
+	uintptr_t prime;
+	struct filter *next;
+};
+
+static unsigned int max = MAXPRIME;
+
+/* Source generator: produces all numbers, from 2 to max */
+static void source(void *arg)
+{
+	(void)arg;
+
+	for (uintptr_t i = 2; i <= max; i++)
+		gen_yield((void *)i);
+}
+
+/* Filter generator */
+static void filter(void *arg)
+{
+	struct filter *f = arg;
+	void *value;
+
+	while (gen_next(f->left, &value) == 0)
+		if ((uintptr_t)value % f->prime != 0)
+			gen_yield(value);
+}
+
+/* Consumer thread */
+static void sink(void *arg)
+{
+	gen_t numbers = gen_create(source, NULL);
+	gen_t primes = numbers;
+	struct filter *f_head = NULL;
+	void *value;
+	(void)arg;
+
+	while (gen_next(primes, &value) == 0)
+	{
+		struct filter *f = malloc(sizeof(*f));
+
+		printf("%d is prime.\n", (int)(uintptr_t)value);
+
+		f->left = primes;
+		f->prime = (uintptr_t)value;
+		f->self = gen_create(filter, f);
+		f->next = f_head;
+		f_head = f;
+		primes = f->self;
+	}
+
+	while (f_head)
+	{
+		struct filter *next = f_head->next;
+
+		gen_destroy(f_head->self);
+		free(f_head);
+		f_head = next;
+	}
+	gen_destroy(numbers);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1)
+		max = get_argv(argv[1]);
+
+	uthread_run(false, sink, NULL);
+
+	return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * Generator test
+ *
+ * Check values come out of generators in order, outside and inside of
+ * uthread_run(), including from a generator blocking on a semaphore on behalf
+ * of a consumer running on the shared stack while another thread uses it.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gen.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define NR_VALUES 10
+
+static void count(void *arg)
+{
+	uintptr_t n = (uintptr_t)arg;
+
+	for (uintptr_t i = 0; i < n; i++)
+		gen_yield((void *)i);
+}
+
+static void test_outside_run(void)
+{
+	gen_t gen = gen_create(count, (void *)NR_VALUES);
+	void *value;
+	int ok = 1;
+
+	TEST_ASSERT(gen != NULL);
+	for (uintptr_t i = 0; i < NR_VALUES; i++)
+		if (gen_next(gen, &value) != 0 || (uintptr_t)value != i)
+			ok = 0;
+	TEST_ASSERT(ok);
+	TEST_ASSERT(gen_next(gen, &value) == 1);
+	TEST_ASSERT(gen_next(gen, &value) == 1);
+	TEST_ASSERT(gen_destroy(gen) == 0);
+
+	gen = gen_create(count, (void *)NR_VALUES);
+	TEST_ASSERT(gen_next(gen, &value) == 0);
+	TEST_ASSERT(gen_destroy(gen) == 0);
+
+	TEST_ASSERT(gen_create(NULL, NULL) == NULL);
+	TEST_ASSERT(gen_next(NULL, &value) == -1);
+	TEST_ASSERT(gen_destroy(NULL) == -1);
+	TEST_ASSERT(gen_yield(NULL) == -1);
+}
+
+/*
+ * Blocking generator
+ */
+static sem_t sem;
+static int nr_other;
+
+/* Produces a value each time the semaphore is released */
+static void waiting(void *arg)
+{
+	(void)arg;
+
+	for (uintptr_t i = 0; i < NR_VALUES; i++)
+	{
+		sem_down(sem);
+		gen_yield((void *)i);
+	}
+}
+
+static void releaser(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < NR_VALUES; i++)
+	{
+		nr_other++;
+		sem_up(sem);
+		uthread_yield();
+	}
+}
+
+static void consumer(void *arg)
+{
+	volatile uintptr_t frame[64];
+	gen_t gen = gen_create(waiting, NULL);
+	uthread_attr_t attr;
+	void *value;
+	int ok = 1;
+	(void)arg;
+
+	for (int i = 0; i < 64; i++)
+		frame[i] = i;
+
+	uthread_attr_init(&attr);
+	attr.stack_flags = UTHREAD_STACK_SHARED;
+	uthread_create_attr(releaser, NULL, &attr, NULL);
+
+	for (uintptr_t i = 0; i < NR_VALUES; i++)
+		if (gen_next(gen, &value) != 0 || (uintptr_t)value != i)
+			ok = 0;
+	TEST_ASSERT(ok);
+	TEST_ASSERT(nr_other == NR_VALUES);
+	TEST_ASSERT(gen_next(gen, &value) == 1);
+	gen_destroy(gen);
+
+	for (int i = 0; i < 64; i++)
+		if (frame[i] != (uintptr_t)i)
+			ok = 0;
+	TEST_ASSERT(ok);
+}
+
+static void spawner(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	uthread_attr_init(&attr);
+	attr.stack_flags = UTHREAD_STACK_SHARED;
+	uthread_create_attr(consumer, NULL, &attr, NULL);
+}
+
+int main(void)
+{
+	test_outside_run();
+
+	sem = sem_create(0);
+	uthread_run(false, spawner, NULL);
+	TEST_ASSERT(nr_other == NR_VALUES);
+	sem_destroy(sem);
+
+	return 0;
+}
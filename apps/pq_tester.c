@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pq.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+static int int_cmp(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+// Test pq_create and pq_destroy
+void test_create(void)
+{
+	pq_t pq;
+	int data = 3;
+
+	fprintf(stderr, "*** TEST create ***\n");
+
+	TEST_ASSERT(pq_create(NULL) == NULL);
+	pq = pq_create(int_cmp);
+	TEST_ASSERT(pq != NULL);
+	TEST_ASSERT(pq_length(pq) == 0);
+	pq_insert(pq, &data, NULL);
+	TEST_ASSERT(pq_destroy(pq) == -1);
+	pq_extract_min(pq, (void **)&data);
+	TEST_ASSERT(pq_destroy(pq) == 0);
+}
+
+// Test pq_insert and pq_extract_min return items in order
+void test_order(void)
+{
+	int data[100];
+	int *ptr, *prev = NULL;
+	int i, sorted = 1;
+	pq_t pq;
+
+	fprintf(stderr, "*** TEST order ***\n");
+
+	pq = pq_create(int_cmp);
+	for (i = 0; i < 100; i++)
+	{
+		data[i] = (i * 37) % 100;
+		pq_insert(pq, &data[i], NULL);
+	}
+	TEST_ASSERT(pq_length(pq) == 100);
+	TEST_ASSERT(pq_peek(pq, (void **)&ptr) == 0 && *ptr == 0);
+	while (pq_extract_min(pq, (void **)&ptr) == 0)
+	{
+		if (prev && *prev > *ptr)
+			sorted = 0;
+		prev = ptr;
+	}
+	TEST_ASSERT(sorted);
+	TEST_ASSERT(pq_length(pq) == 0);
+	TEST_ASSERT(pq_extract_min(pq, (void **)&ptr) == -1);
+	TEST_ASSERT(pq_destroy(pq) == 0);
+}
+
+// Test pq_decrease_key and pq_remove_handle
+void test_handles(void)
+{
+	int data[10];
+	pq_handle_t handles[10];
+	int *ptr;
+	int i;
+	pq_t pq;
+
+	fprintf(stderr, "*** TEST handles ***\n");
+
+	pq = pq_create(int_cmp);
+	for (i = 0; i < 10; i++)
+	{
+		data[i] = 10 + i;
+		pq_insert(pq, &data[i], &handles[i]);
+	}
+	data[7] = 1;
+	TEST_ASSERT(pq_decrease_key(pq, handles[7]) == 0);
+	TEST_ASSERT(pq_peek(pq, (void **)&ptr) == 0 && ptr == &data[7]);
+	TEST_ASSERT(pq_remove_handle(pq, handles[7]) == 0);
+	TEST_ASSERT(pq_remove_handle(pq, handles[0]) == 0);
+	TEST_ASSERT(pq_remove_handle(pq, handles[9]) == 0);
+	TEST_ASSERT(pq_length(pq) == 7);
+	TEST_ASSERT(pq_extract_min(pq, (void **)&ptr) == 0 && ptr == &data[1]);
+	TEST_ASSERT(pq_remove_handle(pq, NULL) == -1);
+	while (pq_extract_min(pq, (void **)&ptr) == 0)
+		;
+	TEST_ASSERT(ptr == &data[8]);
+	TEST_ASSERT(pq_destroy(pq) == 0);
+}
+
+int main(void)
+{
+	test_create();
+	test_order();
+	test_handles();
+	return 0;
+}
@@ -116,6 +116,59 @@ void test_queue_delete(void)
     TEST_ASSERT(queue_delete(q, &data) == -1);
 }
 
+// Test queue_enqueue_handle and queue_remove_handle
+void test_queue_remove_handle(void)
+{
+    int data_1 = 1, data_2 = 2, data_3 = 3;
+    int *ptr = NULL;
+    queue_handle_t h_1, h_2, h_3;
+    queue_t q;
+
+    fprintf(stderr, "*** TEST queue_remove_handle ***\n");
+
+    q = queue_create();
+    TEST_ASSERT(queue_enqueue_handle(q, &data_1, &h_1) == 0);
+    TEST_ASSERT(queue_enqueue_handle(q, &data_2, &h_2) == 0);
+    TEST_ASSERT(queue_enqueue_handle(q, &data_3, &h_3) == 0);
+    TEST_ASSERT(queue_remove_handle(q, h_2) == 0);
+    TEST_ASSERT(queue_length(q) == 2);
+    TEST_ASSERT(queue_remove_handle(q, h_3) == 0);
+    TEST_ASSERT(queue_enqueue(q, &data_3) == 0);
+    TEST_ASSERT(queue_remove_handle(q, h_1) == 0);
+    queue_dequeue(q, (void **)&ptr);
+    TEST_ASSERT(ptr == &data_3);
+    TEST_ASSERT(queue_length(q) == 0);
+    TEST_ASSERT(queue_remove_handle(q, NULL) == -1);
+    TEST_ASSERT(queue_destroy(q) == 0);
+}
+
+// Test queue_enqueue_bulk, queue_dequeue_bulk and queue_splice
+void test_queue_bulk(void)
+{
+    int data[5] = {0, 1, 2, 3, 4};
+    void *in[5] = {&data[0], &data[1], &data[2], &data[3], &data[4]};
+    void *out[5] = {NULL};
+    queue_t q_1, q_2;
+
+    fprintf(stderr, "*** TEST queue_bulk ***\n");
+
+    q_1 = queue_create();
+    q_2 = queue_create();
+    TEST_ASSERT(queue_enqueue_bulk(q_1, in, 3) == 0);
+    TEST_ASSERT(queue_length(q_1) == 3);
+    in[4] = NULL;
+    TEST_ASSERT(queue_enqueue_bulk(q_2, &in[3], 2) == -1);
+    TEST_ASSERT(queue_length(q_2) == 0);
+    TEST_ASSERT(queue_enqueue_bulk(q_2, &in[3], 1) == 0);
+    TEST_ASSERT(queue_splice(q_1, q_2) == 0);
+    TEST_ASSERT(queue_length(q_1) == 4 && queue_length(q_2) == 0);
+    TEST_ASSERT(queue_splice(q_1, q_1) == -1);
+    TEST_ASSERT(queue_dequeue_bulk(q_1, out, 5) == 4);
+    TEST_ASSERT(out[0] == &data[0] && out[3] == &data[3]);
+    TEST_ASSERT(queue_dequeue_bulk(q_1, out, 5) == 0);
+    TEST_ASSERT(queue_destroy(q_1) == 0 && queue_destroy(q_2) == 0);
+}
+
 int iterate_sum = 0;
 int iterate_count = 0;
 
@@ -152,6 +205,8 @@ int main()
     test_queue_length();
     test_queue_destroy();
     test_queue_delete();
+    test_queue_remove_handle();
+    test_queue_bulk();
     test_queue_iterate();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,125 @@
+/*
+ * Semaphores shared between runtimes
+ *
+ * Two kernel threads each run a runtime whose threads increment a counter in
+ * a critical section guarded by a semaphore, so the count must come out exact.
+ * Then a thread of one runtime produces items consumed by a thread of the
+ * other, through a semaphore the consumer mostly blocks on.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define NR_RUNTIMES 2
+#define NR_WORKERS 4
+#define NR_INCREMENTS 20000
+#define NR_ITEMS 20000
+
+static sem_t mutex, items, started;
+static unsigned long counter;
+static unsigned long nr_consumed;
+
+static void incrementer(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < NR_INCREMENTS; i++)
+	{
+		sem_down(mutex);
+		counter++;
+		sem_up(mutex);
+	}
+}
+
+static void incrementers(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < NR_WORKERS; i++)
+		uthread_create(incrementer, NULL);
+}
+
+static void producer(void *arg)
+{
+	(void)arg;
+
+	// Start once the consumer runs
+	sem_down(started);
+	for (int i = 0; i < NR_ITEMS; i++)
+		sem_up(items);
+}
+
+static void consumer(void *arg)
+{
+	(void)arg;
+
+	sem_up(started);
+	for (int i = 0; i < NR_ITEMS; i++)
+	{
+		sem_down(items);
+		nr_consumed++;
+	}
+}
+
+/* Wait for both runtimes to run, not to block on a semaphore in one alone */
+static void start(void *arg)
+{
+	uthread_func_t func = arg;
+
+	while (uthread_nr_runtimes() < NR_RUNTIMES)
+		sched_yield();
+	func(NULL);
+}
+
+static void *kernel_thread(void *arg)
+{
+	uthread_run(false, start, arg);
+	return NULL;
+}
+
+static void run_pair(uthread_func_t first, uthread_func_t second)
+{
+	pthread_t threads[NR_RUNTIMES];
+
+	pthread_create(&threads[0], NULL, kernel_thread, first);
+	pthread_create(&threads[1], NULL, kernel_thread, second);
+	for (int i = 0; i < NR_RUNTIMES; i++)
+		pthread_join(threads[i], NULL);
+}
+
+int main(void)
+{
+	mutex = sem_create(1);
+	run_pair(incrementers, incrementers);
+	TEST_ASSERT(counter == NR_RUNTIMES * NR_WORKERS * NR_INCREMENTS);
+	TEST_ASSERT(sem_destroy(mutex) == 0);
+
+	items = sem_create(0);
+	started = sem_create(0);
+	run_pair(consumer, producer);
+	TEST_ASSERT(nr_consumed == NR_ITEMS);
+	TEST_ASSERT(sem_destroy(items) == 0);
+	TEST_ASSERT(sem_destroy(started) == 0);
+
+	return 0;
+}
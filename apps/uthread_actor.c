@@ -0,0 +1,164 @@
+/*
+ * Actor test
+ *
+ * A busy actor must handle a burst of messages in order and in few context
+ * switches, idle actors must not be scheduled at all, and a kernel thread
+ * outside of any runtime must be able to wake an actor up.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <actor.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define NR_MSGS 1000
+#define NR_REMOTE 10000
+#define NR_IDLE 100
+#define MS 1000000ULL
+
+struct number
+{
+	struct actor_msg msg;
+	int value;
+};
+
+static struct number numbers[NR_MSGS];
+static struct number remote[NR_REMOTE];
+static int nr_handled;
+static int last = -1;
+static int in_order = 1;
+
+static void handle(struct actor_msg *msg, void *arg)
+{
+	struct number *number = (struct number *)msg;
+	(void)arg;
+
+	if (number->value != last + 1)
+		in_order = 0;
+	last = number->value;
+	__atomic_add_fetch(&nr_handled, 1, __ATOMIC_RELAXED);
+}
+
+static void never(struct actor_msg *msg, void *arg)
+{
+	(void)msg;
+	(void)arg;
+
+	exit(1);
+}
+
+static unsigned long long nr_switches(void)
+{
+	struct uthread_stats stats;
+
+	uthread_stats(&stats);
+	return stats.nr_switches;
+}
+
+static void *sender(void *arg)
+{
+	actor_t actor = arg;
+
+	for (int i = 0; i < NR_REMOTE; i++)
+	{
+		remote[i].value = i;
+		actor_send(actor, &remote[i].msg);
+	}
+	return NULL;
+}
+
+static void test_burst(void)
+{
+	actor_t actor = actor_create(handle, NULL);
+	unsigned long long switches;
+
+	TEST_ASSERT(actor != NULL);
+	// Let it park
+	uthread_yield();
+
+	switches = nr_switches();
+	for (int i = 0; i < NR_MSGS; i++)
+	{
+		numbers[i].value = i;
+		actor_send(actor, &numbers[i].msg);
+	}
+	while (nr_handled < NR_MSGS)
+		uthread_yield();
+	TEST_ASSERT(in_order);
+	TEST_ASSERT(nr_switches() - switches <= 4 * (NR_MSGS / ACTOR_BATCH + 1));
+	TEST_ASSERT(actor_destroy(actor) == 0);
+}
+
+static void test_idle(void)
+{
+	actor_t actors[NR_IDLE];
+	unsigned long long switches;
+
+	for (int i = 0; i < NR_IDLE; i++)
+		actors[i] = actor_create(never, NULL);
+	uthread_yield();
+
+	switches = nr_switches();
+	for (int i = 0; i < 10; i++)
+		uthread_yield();
+	TEST_ASSERT(nr_switches() - switches <= 2 * 10);
+
+	for (int i = 0; i < NR_IDLE; i++)
+		actor_destroy(actors[i]);
+}
+
+static void test_remote(void)
+{
+	actor_t actor = actor_create(handle, NULL);
+	pthread_t thread;
+
+	nr_handled = 0;
+	last = -1;
+	pthread_create(&thread, NULL, sender, actor);
+	while (__atomic_load_n(&nr_handled, __ATOMIC_RELAXED) < NR_REMOTE)
+		uthread_sleep(1 * MS);
+	pthread_join(thread, NULL);
+	TEST_ASSERT(in_order);
+	actor_destroy(actor);
+}
+
+static void test_actor(void *arg)
+{
+	(void)arg;
+
+	TEST_ASSERT(actor_create(NULL, NULL) == NULL);
+	TEST_ASSERT(actor_send(NULL, &numbers[0].msg) == -1);
+	TEST_ASSERT(actor_destroy(NULL) == -1);
+
+	test_burst();
+	test_idle();
+	test_remote();
+}
+
+int main(void)
+{
+	TEST_ASSERT(actor_create(handle, NULL) == NULL);
+
+	// Returns once all actors are destroyed
+	TEST_ASSERT(uthread_run(false, test_actor, NULL) == 0);
+	TEST_ASSERT(nr_handled == NR_REMOTE);
+
+	return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Runtime placement test
+ *
+ * Run a runtime pinned to the first CPU the process may use, check its threads
+ * run there and that the runtime reports where it is, then that the kernel
+ * thread gets its previous affinity back once uthread_run_attr() returns.
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+static int cpu;
+
+static void pinned(void *arg)
+{
+	uthread_runtime_t rt = uthread_runtime_self();
+	(void)arg;
+
+	TEST_ASSERT(sched_getcpu() == cpu);
+	uthread_yield();
+	TEST_ASSERT(sched_getcpu() == cpu);
+	TEST_ASSERT(uthread_runtime_cpu(rt) == cpu);
+	TEST_ASSERT(uthread_runtime_node(rt) >= 0);
+}
+
+static void unpinned(void *arg)
+{
+	uthread_runtime_t rt = uthread_runtime_self();
+	(void)arg;
+
+	TEST_ASSERT(uthread_runtime_cpu(rt) == -1);
+	TEST_ASSERT(uthread_runtime_node(rt) == -1);
+}
+
+int main(void)
+{
+	uthread_runtime_attr_t attr;
+	cpu_set_t before, after;
+
+	TEST_ASSERT(uthread_runtime_attr_init(NULL) == -1);
+	TEST_ASSERT(uthread_runtime_attr_init(&attr) == 0);
+	TEST_ASSERT(attr.cpu == -1);
+	TEST_ASSERT(uthread_runtime_cpu(NULL) == -1);
+
+	TEST_ASSERT(sched_getaffinity(0, sizeof(before), &before) == 0);
+	for (cpu = 0; !CPU_ISSET(cpu, &before); cpu++)
+		;
+
+	attr.cpu = cpu;
+	TEST_ASSERT(uthread_run_attr(false, pinned, NULL, &attr) == 0);
+	TEST_ASSERT(sched_getaffinity(0, sizeof(after), &after) == 0);
+	TEST_ASSERT(CPU_EQUAL(&before, &after));
+
+	TEST_ASSERT(uthread_run_attr(false, unpinned, NULL, NULL) == 0);
+
+	attr.cpu = CPU_SETSIZE;
+	TEST_ASSERT(uthread_run_attr(false, unpinned, NULL, &attr) == -1);
+
+	return 0;
+}
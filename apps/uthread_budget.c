@@ -0,0 +1,93 @@
+/*
+ * Yield budget test
+ *
+ * A thread taking a semaphore that is always available, then consuming a
+ * generator, never blocks: without preemption, the yield budget is the only
+ * thing letting another thread run in the meantime.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gen.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define NR_OPS (8 * UTHREAD_YIELD_BUDGET)
+
+static sem_t sem;
+static int nr_ticks;
+static int done;
+
+static void ticker(void *arg)
+{
+	(void)arg;
+
+	while (!done)
+	{
+		nr_ticks++;
+		uthread_yield();
+	}
+}
+
+static void counter(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < NR_OPS; i++)
+		gen_yield(NULL);
+}
+
+static void greedy(void *arg)
+{
+	struct uthread_stats stats;
+	void *value;
+	gen_t gen;
+	int ticks;
+	(void)arg;
+
+	uthread_create(ticker, NULL);
+	ticks = nr_ticks;
+	for (int i = 0; i < NR_OPS; i++)
+		sem_down(sem);
+	TEST_ASSERT(nr_ticks - ticks >= NR_OPS / UTHREAD_YIELD_BUDGET - 1);
+
+	gen = gen_create(counter, NULL);
+	ticks = nr_ticks;
+	while (gen_next(gen, &value) == 0)
+		;
+	gen_destroy(gen);
+	TEST_ASSERT(nr_ticks - ticks >= NR_OPS / UTHREAD_YIELD_BUDGET - 1);
+
+	uthread_stats(&stats);
+	TEST_ASSERT(stats.nr_budget_yields >=
+				2 * (NR_OPS / UTHREAD_YIELD_BUDGET - 1));
+	done = 1;
+}
+
+int main(void)
+{
+	sem = sem_create(NR_OPS);
+	TEST_ASSERT(uthread_run(false, greedy, NULL) == 0);
+	sem_destroy(sem);
+
+	// Outside of uthread_run(), there is nothing to yield to
+	uthread_consume_budget();
+
+	return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ * Cancellation and deadlines test
+ *
+ * Cancel threads blocked on a semaphore, sleeping, or woken up but not running
+ * yet, by identifier or through a handle, and let deadlines cancel a busy
+ * thread and a sleeping one.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define MS 1000000ULL
+
+static sem_t sem;
+static int ret, err;
+static int nr_ticks;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void waiter(void *arg)
+{
+	(void)arg;
+
+	errno = 0;
+	ret = sem_down(sem);
+	err = errno;
+}
+
+static void sleeper(void *arg)
+{
+	unsigned long long ns = *(unsigned long long *)arg;
+
+	errno = 0;
+	ret = uthread_sleep(ns);
+	err = errno;
+}
+
+static void busy(void *arg)
+{
+	(void)arg;
+
+	while (!uthread_cancelled())
+		uthread_yield();
+}
+
+static void ticker(void *arg)
+{
+	int *stop = arg;
+
+	while (!*stop)
+	{
+		nr_ticks++;
+		uthread_yield();
+	}
+}
+
+static void test_cancel(void *arg)
+{
+	unsigned long long ns = 10000 * MS;
+	uthread_t thread;
+	int tid;
+	(void)arg;
+
+	TEST_ASSERT(uthread_cancel(-5) == -1);
+
+	// Blocked on a semaphore
+	uthread_create_attr(waiter, NULL, NULL, &tid);
+	uthread_yield();
+	TEST_ASSERT(uthread_cancel(tid) == 0);
+	uthread_yield();
+	TEST_ASSERT(ret == -1 && err == ECANCELED);
+	TEST_ASSERT(uthread_cancel(tid) == -1);
+
+	// Woken up, but not running yet: it got the semaphore
+	uthread_create_attr(waiter, NULL, NULL, &tid);
+	uthread_yield();
+	sem_up(sem);
+	TEST_ASSERT(uthread_cancel(tid) == 0);
+	uthread_yield();
+	TEST_ASSERT(ret == 0);
+
+	// Sleeping
+	uthread_create_attr(sleeper, &ns, NULL, &tid);
+	uthread_yield();
+	TEST_ASSERT(uthread_cancel(tid) == 0);
+	uthread_yield();
+	TEST_ASSERT(ret == -1 && err == ECANCELED);
+
+	// Through handles, out of the middle of the queue of the semaphore
+	TEST_ASSERT(uthread_cancel_handle(NULL) == -1);
+	uthread_create_handle(waiter, NULL, NULL);
+	thread = uthread_create_handle(waiter, NULL, NULL);
+	uthread_create_handle(waiter, NULL, NULL);
+	uthread_yield();
+	TEST_ASSERT(uthread_cancel_handle(thread) == 0);
+	uthread_yield();
+	TEST_ASSERT(ret == -1 && err == ECANCELED);
+	sem_up(sem);
+	sem_up(sem);
+	uthread_yield();
+	TEST_ASSERT(ret == 0);
+
+	// Cancellation sticks
+	TEST_ASSERT(uthread_cancel(uthread_self()) == 0);
+	TEST_ASSERT(uthread_cancelled());
+	sem_up(sem);
+	errno = 0;
+	TEST_ASSERT(sem_down(sem) == -1 && errno == ECANCELED);
+	TEST_ASSERT(uthread_sleep(0) == -1);
+}
+
+static unsigned long long cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void lone_sleeper(void *arg)
+{
+	(void)arg;
+
+	uthread_sleep(50 * MS);
+}
+
+static void test_sleep(void *arg)
+{
+	unsigned long long start = now_ns();
+	int stop = 0;
+	(void)arg;
+
+	uthread_create(ticker, &stop);
+	TEST_ASSERT(uthread_sleep(20 * MS) == 0);
+	TEST_ASSERT(now_ns() - start >= 20 * MS);
+	TEST_ASSERT(nr_ticks > 0);
+	stop = 1;
+}
+
+static void short_sleeper(void *arg)
+{
+	int *result = arg;
+
+	*result = uthread_sleep(30 * MS);
+}
+
+static void test_deadline(void *arg)
+{
+	unsigned long long ns = 10000 * MS;
+	int *result = arg;
+	uthread_t thread;
+	int tid;
+
+	thread = uthread_create_handle(busy, NULL, NULL);
+	TEST_ASSERT(uthread_set_deadline_handle(thread, 10 * MS) == 0);
+
+	// Replaced by a shorter deadline
+	uthread_create_attr(sleeper, &ns, NULL, &tid);
+	TEST_ASSERT(uthread_set_deadline(tid, 5000 * MS) == 0);
+	TEST_ASSERT(uthread_set_deadline(tid, 20 * MS) == 0);
+
+	// Removed
+	uthread_create_attr(short_sleeper, result, NULL, &tid);
+	TEST_ASSERT(uthread_set_deadline(tid, 1 * MS) == 0);
+	TEST_ASSERT(uthread_set_deadline(tid, 0) == 0);
+
+	TEST_ASSERT(uthread_set_deadline(-5, 20 * MS) == -1);
+	TEST_ASSERT(uthread_set_deadline_handle(NULL, 20 * MS) == -1);
+}
+
+int main(void)
+{
+	unsigned long long start;
+	int result = -1;
+
+	sem = sem_create(0);
+	TEST_ASSERT(uthread_run(false, test_cancel, NULL) == 0);
+	TEST_ASSERT(uthread_sleep(0) == -1);
+	TEST_ASSERT(!uthread_cancelled());
+
+	TEST_ASSERT(uthread_run(false, test_sleep, NULL) == 0);
+
+	// Waiting for nothing but a timer, the runtime sleeps rather than spins
+	start = cpu_ns();
+	TEST_ASSERT(uthread_run(false, lone_sleeper, NULL) == 0);
+	TEST_ASSERT(cpu_ns() - start < 25 * MS);
+
+	start = now_ns();
+	TEST_ASSERT(uthread_run(false, test_deadline, &result) == 0);
+	TEST_ASSERT(ret == -1 && err == ECANCELED);
+	TEST_ASSERT(result == 0);
+	TEST_ASSERT(now_ns() - start >= 20 * MS);
+	TEST_ASSERT(now_ns() - start < 5000 * MS);
+	TEST_ASSERT(sem_destroy(sem) == 0);
+
+	return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * Task group test
+ *
+ * Fan out to many children and wait for all of them at once, then let a
+ * failing child cancel its siblings blocked on a semaphore or sleeping, cancel
+ * a group explicitly, and have a cancelled parent take its children down with
+ * it.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <group.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define NR_CHILDREN 200
+#define MS 1000000ULL
+
+static sem_t sem;
+static int sum;
+static int nr_cancelled;
+static int parent_tid;
+static int parent_status;
+
+static int adder(void *arg)
+{
+	uthread_yield();
+	sum += *(int *)arg;
+	return 0;
+}
+
+static int waiter(void *arg)
+{
+	(void)arg;
+
+	if (sem_down(sem) == -1 && errno == ECANCELED)
+		nr_cancelled++;
+	return 0;
+}
+
+static int sleeper(void *arg)
+{
+	(void)arg;
+
+	if (uthread_sleep(10000 * MS) == -1 && errno == ECANCELED)
+		nr_cancelled++;
+	return 0;
+}
+
+static int failer(void *arg)
+{
+	uthread_yield();
+	return *(int *)arg;
+}
+
+static int checker(void *arg)
+{
+	(void)arg;
+
+	if (uthread_cancelled())
+		nr_cancelled++;
+	return 0;
+}
+
+static void parent(void *arg)
+{
+	group_t group = arg;
+
+	parent_tid = uthread_self();
+	group_spawn(group, sleeper, NULL);
+	group_wait(group, &parent_status);
+}
+
+static void test_fan_out(group_t group)
+{
+	struct uthread_stats before, after;
+	int values[NR_CHILDREN];
+	int status = -1;
+
+	uthread_stats(&before);
+	for (int i = 0; i < NR_CHILDREN; i++)
+	{
+		values[i] = i;
+		TEST_ASSERT(group_spawn(group, adder, &values[i]) == 0);
+	}
+	TEST_ASSERT(group_wait(group, &status) == 0);
+	TEST_ASSERT(status == 0);
+	TEST_ASSERT(sum == NR_CHILDREN * (NR_CHILDREN - 1) / 2);
+	uthread_stats(&after);
+	TEST_ASSERT(after.nr_exited - before.nr_exited == NR_CHILDREN);
+	TEST_ASSERT(after.nr_threads == before.nr_threads);
+
+	// Nothing to wait for
+	TEST_ASSERT(group_wait(group, &status) == 0);
+	TEST_ASSERT(status == 0);
+}
+
+static void test_failure(group_t group)
+{
+	int first = 42, second = 7;
+	int status = -1;
+
+	nr_cancelled = 0;
+	for (int i = 0; i < 4; i++)
+		group_spawn(group, waiter, NULL);
+	group_spawn(group, sleeper, NULL);
+	group_spawn(group, failer, &first);
+	group_spawn(group, failer, &second);
+	// Let the failures happen before spawning into the cancelled group
+	uthread_yield();
+	uthread_yield();
+	group_spawn(group, checker, NULL);
+	TEST_ASSERT(group_wait(group, &status) == 0);
+	TEST_ASSERT(status == 42);
+	TEST_ASSERT(nr_cancelled == 6);
+
+	// Starting over
+	group_spawn(group, checker, NULL);
+	TEST_ASSERT(group_wait(group, &status) == 0);
+	TEST_ASSERT(status == 0);
+	TEST_ASSERT(nr_cancelled == 6);
+}
+
+static void test_blocked_parent(group_t group)
+{
+	nr_cancelled = 0;
+	parent_status = -1;
+	TEST_ASSERT(uthread_create(parent, group) == 0);
+	// Let the parent block in group_wait()
+	uthread_yield();
+	uthread_yield();
+	TEST_ASSERT(uthread_cancel(parent_tid) == 0);
+	while (parent_status == -1)
+		uthread_yield();
+	TEST_ASSERT(parent_status == 0);
+	TEST_ASSERT(nr_cancelled == 1);
+}
+
+static void test_cancel(group_t group)
+{
+	int status = -1;
+
+	nr_cancelled = 0;
+	group_spawn(group, waiter, NULL);
+	group_spawn(group, sleeper, NULL);
+	uthread_yield();
+	TEST_ASSERT(group_destroy(group) == -1);
+	TEST_ASSERT(group_cancel(group) == 0);
+	TEST_ASSERT(group_wait(group, &status) == 0);
+	TEST_ASSERT(status == 0);
+	TEST_ASSERT(nr_cancelled == 2);
+
+	// By cancelling the waiting parent
+	nr_cancelled = 0;
+	group_spawn(group, sleeper, NULL);
+	uthread_cancel(uthread_self());
+	TEST_ASSERT(group_wait(group, &status) == 0);
+	TEST_ASSERT(nr_cancelled == 1);
+}
+
+static void test_group(void *arg)
+{
+	group_t group = group_create();
+	(void)arg;
+
+	TEST_ASSERT(group != NULL);
+	TEST_ASSERT(group_spawn(NULL, adder, NULL) == -1);
+	TEST_ASSERT(group_spawn(group, NULL, NULL) == -1);
+	TEST_ASSERT(group_wait(group, NULL) == -1);
+	TEST_ASSERT(group_cancel(NULL) == -1);
+
+	test_fan_out(group);
+	test_failure(group);
+	test_blocked_parent(group);
+	test_cancel(group);
+	TEST_ASSERT(group_destroy(group) == 0);
+}
+
+int main(void)
+{
+	group_t group = group_create();
+	int status;
+
+	TEST_ASSERT(group_spawn(group, adder, NULL) == -1);
+	TEST_ASSERT(group_wait(group, &status) == -1);
+	TEST_ASSERT(group_destroy(group) == 0);
+	TEST_ASSERT(group_destroy(NULL) == -1);
+
+	sem = sem_create(0);
+	TEST_ASSERT(uthread_run(false, test_group, NULL) == 0);
+	TEST_ASSERT(sem_destroy(sem) == 0);
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * Growable stack test
+ *
+ * Idle threads with growable stacks must only commit a page or two, a thread
+ * recursing deep must get all the stack it needs, and a thread overflowing its
+ * stack must crash the process with a report naming it (checked in a child
+ * process). Other faults must still reach the handler of the application, and
+ * the alternate signal stack of the application must be back once the library
+ * returns.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define IDLE_THREADS 8
+#define FRAME_BYTES 1024
+#define DEEP_FRAMES 1024
+
+static volatile sig_atomic_t nr_app_faults;
+
+static void app_handler(int signo)
+{
+	(void)signo;
+
+	nr_app_faults++;
+}
+
+static int recurse(int depth)
+{
+	volatile char frame[FRAME_BYTES];
+
+	frame[0] = depth;
+	if (depth == 0)
+		return frame[0];
+	return recurse(depth - 1) + frame[0];
+}
+
+static void idle(void *arg)
+{
+	(void)arg;
+
+	uthread_yield();
+}
+
+static void deep(void *arg)
+{
+	(void)arg;
+
+	recurse(DEEP_FRAMES);
+}
+
+static void overflow(void *arg)
+{
+	(void)arg;
+
+	// Never stops, as far as the compiler knows
+	recurse(getpid() > 0 ? -1 : 0);
+}
+
+static void spawner(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	uthread_attr_init(&attr);
+	attr.stack_flags = UTHREAD_STACK_GROWABLE;
+	for (int i = 0; i < IDLE_THREADS; i++)
+		TEST_ASSERT(uthread_create_attr(idle, NULL, &attr, NULL) == 0);
+	TEST_ASSERT(uthread_create_attr(deep, NULL, &attr, NULL) == 0);
+}
+
+static void overflow_spawner(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	uthread_attr_init(&attr);
+	attr.stack_flags = UTHREAD_STACK_GROWABLE;
+	attr.stack_size = 64 * 1024;
+	uthread_create_attr(overflow, NULL, &attr, NULL);
+}
+
+static void test_overflow(void)
+{
+	char buf[256] = "";
+	int fds[2], status;
+	ssize_t n;
+	pid_t pid;
+
+	TEST_ASSERT(pipe(fds) == 0);
+	pid = fork();
+	if (pid == 0)
+	{
+		dup2(fds[1], STDERR_FILENO);
+		close(fds[0]);
+		uthread_run(false, overflow_spawner, NULL);
+		exit(0);
+	}
+	close(fds[1]);
+	n = read(fds[0], buf, sizeof(buf) - 1);
+	if (n > 0)
+		buf[n] = '\0';
+	close(fds[0]);
+
+	TEST_ASSERT(waitpid(pid, &status, 0) == pid);
+	TEST_ASSERT(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+	TEST_ASSERT(strstr(buf, "stack overflow in thread ") != NULL);
+}
+
+int main(void)
+{
+	struct uthread_stack_usage usage[4];
+	size_t page = sysconf(_SC_PAGESIZE);
+	stack_t app_ss, ss;
+
+	TEST_ASSERT(signal(SIGSEGV, app_handler) != SIG_ERR);
+	app_ss.ss_sp = malloc(SIGSTKSZ);
+	app_ss.ss_size = SIGSTKSZ;
+	app_ss.ss_flags = 0;
+	TEST_ASSERT(sigaltstack(&app_ss, NULL) == 0);
+
+	uthread_stack_check(true);
+	uthread_run(false, spawner, NULL);
+	uthread_stack_check(false);
+
+	TEST_ASSERT(sigaltstack(NULL, &ss) == 0);
+	TEST_ASSERT(ss.ss_sp == app_ss.ss_sp && ss.ss_size == app_ss.ss_size);
+
+	// Deep runs to completion before the idle threads come back from yielding
+	TEST_ASSERT(uthread_stack_usage(usage, 4) == 3);
+	TEST_ASSERT(usage[1].func == deep);
+	TEST_ASSERT(usage[1].max_used >= FRAME_BYTES * DEEP_FRAMES);
+	TEST_ASSERT(usage[1].max_used < UTHREAD_STACK_RESERVE);
+	TEST_ASSERT(usage[2].func == idle);
+	TEST_ASSERT(usage[2].nr_threads == IDLE_THREADS);
+	TEST_ASSERT(usage[2].max_stack_size == UTHREAD_STACK_RESERVE);
+	TEST_ASSERT(usage[2].max_used > 0 && usage[2].max_used <= 2 * page);
+
+	// Not in a guard page, handed over to the application
+	raise(SIGSEGV);
+	TEST_ASSERT(nr_app_faults == 1);
+
+	test_overflow();
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * Thread-local storage test
+ *
+ * Threads set values for keys stored in the TCB and for keys stored in the
+ * overflow table, check they each see their own values across yields, and
+ * have their destructors called when exiting.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define NR_KEYS (UTHREAD_KEYS_INLINE * 3)
+#define NR_THREADS 4
+
+static uthread_key_t keys[NR_KEYS];
+static uthread_key_t again_key;
+static int nr_wrong;
+static uintptr_t destroyed_sum;
+static int nr_again;
+
+static void destroy(void *value)
+{
+	destroyed_sum += (uintptr_t)value;
+}
+
+/* Sets its value again the first time, to be called a second time */
+static void destroy_again(void *value)
+{
+	if (nr_again++ == 0)
+		uthread_setspecific(again_key, value);
+}
+
+static void worker(void *arg)
+{
+	uintptr_t id = (uintptr_t)arg;
+
+	for (int i = 0; i < NR_KEYS; i++)
+		if (uthread_getspecific(keys[i]) != NULL)
+			nr_wrong++;
+	for (int i = 0; i < NR_KEYS; i++)
+		if (uthread_setspecific(keys[i], (void *)(id * 100 + i)))
+			nr_wrong++;
+
+	uthread_yield();
+
+	for (int i = 0; i < NR_KEYS; i++)
+		if (uthread_getspecific(keys[i]) != (void *)(id * 100 + i))
+			nr_wrong++;
+}
+
+static void spawner(void *arg)
+{
+	(void)arg;
+
+	for (uintptr_t id = 1; id <= NR_THREADS; id++)
+		uthread_create(worker, (void *)id);
+}
+
+static void again(void *arg)
+{
+	(void)arg;
+
+	uthread_setspecific(again_key, (void *)1);
+}
+
+static void deleter(void *arg)
+{
+	uthread_key_t key;
+	(void)arg;
+
+	TEST_ASSERT(uthread_setspecific(keys[0], (void *)42) == 0);
+	TEST_ASSERT(uthread_key_delete(keys[0]) == 0);
+	TEST_ASSERT(uthread_key_delete(keys[0]) == -1);
+	TEST_ASSERT(uthread_setspecific(keys[0], (void *)42) == -1);
+	TEST_ASSERT(uthread_key_create(&key, NULL) == 0);
+	TEST_ASSERT(key == keys[0]);
+	TEST_ASSERT(uthread_getspecific(key) == NULL);
+}
+
+int main(void)
+{
+	uintptr_t expected = 0;
+	uthread_key_t key;
+	int n;
+
+	TEST_ASSERT(uthread_key_create(NULL, NULL) == -1);
+	for (int i = 0; i < NR_KEYS; i++)
+		TEST_ASSERT(uthread_key_create(&keys[i], destroy) == 0);
+	TEST_ASSERT(keys[NR_KEYS - 1] == NR_KEYS - 1);
+	TEST_ASSERT(uthread_setspecific(keys[0], (void *)1) == -1);
+	TEST_ASSERT(uthread_getspecific(keys[0]) == NULL);
+	TEST_ASSERT(uthread_getspecific(-1) == NULL);
+
+	uthread_run(false, spawner, NULL);
+	for (uintptr_t id = 1; id <= NR_THREADS; id++)
+		for (int i = 0; i < NR_KEYS; i++)
+			expected += id * 100 + i;
+	TEST_ASSERT(nr_wrong == 0);
+	TEST_ASSERT(destroyed_sum == expected);
+
+	TEST_ASSERT(uthread_key_create(&again_key, destroy_again) == 0);
+	uthread_run(false, again, NULL);
+	TEST_ASSERT(nr_again == 2);
+
+	uthread_run(false, deleter, NULL);
+
+	for (n = 0; uthread_key_create(&key, NULL) == 0; n++)
+		;
+	TEST_ASSERT(n == UTHREAD_KEYS_MAX - NR_KEYS - 1);
+
+	return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Offloading test
+ *
+ * Threads offload blocking sleeps while another thread keeps running, which
+ * must not be stalled by them. The sleeps must overlap, up to the size of the
+ * pool, and more of them than that must still all complete.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define SLEEP_MS 50
+#define NR_SLEEPERS (UTHREAD_OFFLOAD_THREADS + 4)
+
+static int nr_done;
+static int nr_wrong;
+static unsigned long nr_spins;
+
+static unsigned long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static void *blocking_sleep(void *arg)
+{
+	usleep(SLEEP_MS * 1000);
+	return (void *)((uintptr_t)arg * 2);
+}
+
+static void sleeper(void *arg)
+{
+	void *result;
+
+	if (uthread_offload(blocking_sleep, arg, &result) ||
+		(uintptr_t)result != (uintptr_t)arg * 2)
+		nr_wrong++;
+	nr_done++;
+}
+
+static void spinner(void *arg)
+{
+	(void)arg;
+
+	while (nr_done < NR_SLEEPERS)
+	{
+		nr_spins++;
+		uthread_yield();
+	}
+}
+
+static void spawner(void *arg)
+{
+	(void)arg;
+
+	TEST_ASSERT(uthread_offload(NULL, NULL, NULL) == -1);
+	for (uintptr_t i = 0; i < NR_SLEEPERS; i++)
+		uthread_create(sleeper, (void *)i);
+	uthread_create(spinner, NULL);
+}
+
+/* Alone, so that the idle thread has to wait for the completion */
+static void lone_sleeper(void *arg)
+{
+	(void)arg;
+
+	TEST_ASSERT(uthread_offload(blocking_sleep, NULL, NULL) == 0);
+	nr_done++;
+}
+
+int main(void)
+{
+	unsigned long long start;
+
+	TEST_ASSERT(uthread_offload(blocking_sleep, NULL, NULL) == -1);
+
+	start = now_ms();
+	uthread_run(false, spawner, NULL);
+	TEST_ASSERT(nr_done == NR_SLEEPERS);
+	TEST_ASSERT(nr_wrong == 0);
+	TEST_ASSERT(nr_spins > NR_SLEEPERS);
+	// Two batches of overlapping sleeps, rather than one sleep after the other
+	TEST_ASSERT(now_ms() - start < NR_SLEEPERS * SLEEP_MS / 2);
+
+	nr_done = 0;
+	uthread_run(false, lone_sleeper, NULL);
+	TEST_ASSERT(nr_done == 1);
+
+	return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Parallel loops test
+ *
+ * Three kernel threads keep idle runtimes around to help a fourth one run
+ * loops over a range: every index must be run over exactly once, whichever
+ * runtime got it, and reductions must come out exact. Many short loops, with
+ * helpers finishing last or not, must neither let the runtime of the caller
+ * end nor wake the caller up once it went on.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <parallel.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define NR_HELPERS 3
+#define NR_ITEMS 100000
+#define NR_ROUNDS 10000
+
+static unsigned char seen[NR_ITEMS];
+static uthread_runtime_t helpers[NR_HELPERS];
+static int nr_ready;
+static int nr_participants;
+static int nr_rounds;
+
+/* Index of the kernel thread running a chunk, 0 for the caller's */
+static __thread int participant;
+static __thread int participated;
+
+static void hold(void *arg)
+{
+	int index = *(int *)arg;
+
+	participant = index + 1;
+	helpers[index] = uthread_runtime_hold();
+	__atomic_add_fetch(&nr_ready, 1, __ATOMIC_RELEASE);
+}
+
+static void *kernel_thread(void *arg)
+{
+	uthread_run(false, hold, arg);
+	return NULL;
+}
+
+static void mark(long begin, long end, void *arg)
+{
+	time_t start = time(NULL);
+	(void)arg;
+
+	for (long i = begin; i < end; i++)
+		__atomic_add_fetch(&seen[i], 1, __ATOMIC_RELAXED);
+	if (!participated)
+	{
+		participated = 1;
+		__atomic_add_fetch(&nr_participants, 1, __ATOMIC_RELAXED);
+	}
+	// Hold the caller's first chunk until a helper stole some work
+	while (!participant && __atomic_load_n(&nr_participants,
+										   __ATOMIC_RELAXED) < 2 &&
+		   time(NULL) - start < 10)
+		sched_yield();
+}
+
+static void count(long begin, long end, void *arg)
+{
+	__atomic_add_fetch((long *)arg, end - begin, __ATOMIC_RELAXED);
+}
+
+static void slow_helpers(long begin, long end, void *arg)
+{
+	// Helpers take ten times as long as the caller over a chunk
+	for (int i = 0; i < (participant ? 1000 : 100); i++)
+		__asm__ volatile("" ::: "memory");
+	count(begin, end, arg);
+}
+
+static void test_rounds(void)
+{
+	for (int i = 0; i < NR_ROUNDS; i++)
+	{
+		long done = 0;
+
+		// Woken up too early, the caller would return before the helpers
+		if (parallel_for(0, 64, 1, count, &done) ||
+			parallel_for(0, 128, 1, slow_helpers, &done) ||
+			__atomic_load_n(&done, __ATOMIC_RELAXED) != 64 + 128)
+			break;
+		nr_rounds++;
+		// A stale wake-up would get this thread on the ready queue twice
+		uthread_yield();
+	}
+}
+
+static void sum(long begin, long end, void *acc, void *arg)
+{
+	long long *total = acc;
+	(void)arg;
+
+	for (long i = begin; i < end; i++)
+		*total += i;
+}
+
+static void add(void *acc, const void *other, void *arg)
+{
+	(void)arg;
+
+	*(long long *)acc += *(const long long *)other;
+}
+
+static void test_parallel(void *arg)
+{
+	long long total = 0;
+	int ok = 1;
+	(void)arg;
+
+	TEST_ASSERT(parallel_for(0, 10, 1, NULL, NULL) == -1);
+	TEST_ASSERT(parallel_for(0, 10, -1, mark, NULL) == -1);
+	TEST_ASSERT(parallel_for(10, 0, 1, mark, NULL) == 0);
+	TEST_ASSERT(parallel_reduce(0, 10, 1, sum, add, &total, 0, NULL) == -1);
+
+	TEST_ASSERT(parallel_for(0, NR_ITEMS, 100, mark, NULL) == 0);
+	for (int i = 0; i < NR_ITEMS; i++)
+		if (seen[i] != 1)
+			ok = 0;
+	TEST_ASSERT(ok);
+	TEST_ASSERT(nr_participants >= 2);
+
+	// With a picked grain
+	total = 0;
+	TEST_ASSERT(parallel_reduce(0, NR_ITEMS, 0, sum, add, &total,
+								sizeof(total), NULL) == 0);
+	TEST_ASSERT(total == (long long)NR_ITEMS * (NR_ITEMS - 1) / 2);
+
+	test_rounds();
+}
+
+int main(void)
+{
+	pthread_t threads[NR_HELPERS];
+	int indices[NR_HELPERS];
+	long long total = 0;
+
+	TEST_ASSERT(parallel_reduce(0, 10, 1, sum, add, &total, sizeof(total),
+								NULL) == -1);
+
+	for (int i = 0; i < NR_HELPERS; i++)
+	{
+		indices[i] = i;
+		pthread_create(&threads[i], NULL, kernel_thread, &indices[i]);
+	}
+	while (__atomic_load_n(&nr_ready, __ATOMIC_ACQUIRE) < NR_HELPERS)
+		sched_yield();
+
+	TEST_ASSERT(uthread_run(false, test_parallel, NULL) == 0);
+	TEST_ASSERT(nr_rounds == NR_ROUNDS);
+
+	for (int i = 0; i < NR_HELPERS; i++)
+	{
+		uthread_runtime_release(helpers[i]);
+		pthread_join(threads[i], NULL);
+	}
+
+	return 0;
+}
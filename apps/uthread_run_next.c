@@ -0,0 +1,124 @@
+/*
+ * Run-next slot test
+ *
+ * A thread woken by sem_up() must run right after its waker gives the CPU up,
+ * ahead of the threads already waiting in the ready queue. Two threads waking
+ * each other up in a loop must still let a third one run regularly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define NR_ROUNDS 1000
+
+static sem_t sem, ping, pong;
+static char order[8];
+static int nr_order;
+static int nr_ticks;
+static int done;
+
+static void consumer(void *arg)
+{
+	(void)arg;
+
+	sem_down(sem);
+	order[nr_order++] = 'c';
+}
+
+static void bystander(void *arg)
+{
+	(void)arg;
+
+	order[nr_order++] = 'b';
+}
+
+static void producer(void *arg)
+{
+	(void)arg;
+
+	uthread_create(consumer, NULL);
+	// Let the consumer block
+	uthread_yield();
+	uthread_create(bystander, NULL);
+	sem_up(sem);
+	uthread_yield();
+	order[nr_order++] = 'p';
+}
+
+static void ticker(void *arg)
+{
+	(void)arg;
+
+	while (!done)
+	{
+		nr_ticks++;
+		uthread_yield();
+	}
+}
+
+static void ponger(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < NR_ROUNDS; i++)
+	{
+		sem_down(ping);
+		sem_up(pong);
+	}
+}
+
+static void pinger(void *arg)
+{
+	struct uthread_stats stats;
+	(void)arg;
+
+	uthread_create(ponger, NULL);
+	uthread_create(ticker, NULL);
+	for (int i = 0; i < NR_ROUNDS; i++)
+	{
+		sem_up(ping);
+		sem_down(pong);
+	}
+	done = 1;
+
+	uthread_stats(&stats);
+	TEST_ASSERT(stats.nr_run_next > NR_ROUNDS);
+	// 2 switches per round, the ticker running at least every 17 switches
+	TEST_ASSERT(nr_ticks >= 2 * NR_ROUNDS / 17);
+}
+
+int main(void)
+{
+	sem = sem_create(0);
+	uthread_run(false, producer, NULL);
+	order[nr_order] = '\0';
+	TEST_ASSERT(strcmp(order, "cbp") == 0);
+	sem_destroy(sem);
+
+	ping = sem_create(0);
+	pong = sem_create(0);
+	uthread_run(false, pinger, NULL);
+	sem_destroy(ping);
+	sem_destroy(pong);
+
+	return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Multiple runtimes test
+ *
+ * Several kernel threads each run their own runtime, kept alive by a hold.
+ * The runtime of the main kernel thread sends tasks to them round-robin, each
+ * task checking it runs in the runtime it was sent to and sending a reply back.
+ * Once all the replies came back, the other runtimes are released and must
+ * return from uthread_run().
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define NR_RUNTIMES 4
+#define NR_MSGS 1000
+
+static uthread_runtime_t runtimes[NR_RUNTIMES];
+static uthread_runtime_t main_rt;
+static int nr_ready;
+static int nr_handled;
+static int nr_wrong;
+static int nr_replies;
+
+static void noop(void *arg)
+{
+	(void)arg;
+}
+
+/* First thread of each kernel thread, only holds its runtime */
+static void runtime_main(void *arg)
+{
+	uthread_runtime_t *rt = arg;
+
+	// Threads are numbered per runtime
+	if (uthread_self() != 1)
+		__atomic_add_fetch(&nr_wrong, 1, __ATOMIC_RELAXED);
+	*rt = uthread_runtime_hold();
+	__atomic_add_fetch(&nr_ready, 1, __ATOMIC_RELEASE);
+}
+
+static void *kernel_thread(void *arg)
+{
+	uthread_run(false, runtime_main, arg);
+	return NULL;
+}
+
+/* Runs in the runtime of the main kernel thread */
+static void reply(void *arg)
+{
+	(void)arg;
+
+	if (uthread_runtime_self() != main_rt)
+		nr_wrong++;
+	if (++nr_replies == NR_MSGS)
+		uthread_runtime_release(main_rt);
+}
+
+/* Runs in one of the other runtimes */
+static void request(void *arg)
+{
+	uthread_runtime_t rt = arg;
+
+	if (uthread_runtime_self() != rt)
+		__atomic_add_fetch(&nr_wrong, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&nr_handled, 1, __ATOMIC_RELAXED);
+	uthread_send(main_rt, reply, NULL);
+}
+
+static void sender(void *arg)
+{
+	(void)arg;
+
+	TEST_ASSERT(uthread_run(false, noop, NULL) == -1);
+	TEST_ASSERT(uthread_nr_runtimes() == NR_RUNTIMES + 1);
+
+	// Kept alive by this hold until the last reply
+	main_rt = uthread_runtime_hold();
+	TEST_ASSERT(main_rt == uthread_runtime_self());
+	for (int i = 0; i < NR_MSGS; i++)
+	{
+		uthread_runtime_t rt = runtimes[i % NR_RUNTIMES];
+
+		if (uthread_send(rt, request, rt))
+			nr_wrong++;
+		if (i % 64 == 0)
+			uthread_yield();
+	}
+}
+
+int main(void)
+{
+	pthread_t threads[NR_RUNTIMES];
+
+	TEST_ASSERT(uthread_runtime_self() == NULL);
+	TEST_ASSERT(uthread_runtime_hold() == NULL);
+	TEST_ASSERT(uthread_send(NULL, noop, NULL) == -1);
+	TEST_ASSERT(uthread_nr_runtimes() == 0);
+
+	for (int i = 0; i < NR_RUNTIMES; i++)
+		pthread_create(&threads[i], NULL, kernel_thread, &runtimes[i]);
+	while (__atomic_load_n(&nr_ready, __ATOMIC_ACQUIRE) < NR_RUNTIMES)
+		sched_yield();
+
+	TEST_ASSERT(uthread_run(false, sender, NULL) == 0);
+	TEST_ASSERT(nr_replies == NR_MSGS);
+	TEST_ASSERT(__atomic_load_n(&nr_handled, __ATOMIC_RELAXED) == NR_MSGS);
+
+	for (int i = 0; i < NR_RUNTIMES; i++)
+		uthread_runtime_release(runtimes[i]);
+	for (int i = 0; i < NR_RUNTIMES; i++)
+		pthread_join(threads[i], NULL);
+	TEST_ASSERT(__atomic_load_n(&nr_wrong, __ATOMIC_RELAXED) == 0);
+	TEST_ASSERT(uthread_nr_runtimes() == 0);
+
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Shared stack test
+ *
+ * Many threads running on the shared stack keep data in their frames, at
+ * various depths, while yielding and blocking on semaphores in between
+ * threads with their own stack. Every thread checks its frames survived each
+ * time the shared stack came back to it, over two runs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define NR_SHARED 64
+#define NR_PRIVATE 4
+#define NR_ROUNDS 8
+#define FRAME_WORDS 64
+
+static sem_t sems[NR_SHARED];
+static int nr_corrupted;
+static int nr_done;
+
+/* Fill a frame per level of recursion, reschedule at the bottom, then check */
+static void nest(int id, int depth, int round)
+{
+	volatile int frame[FRAME_WORDS];
+
+	for (int i = 0; i < FRAME_WORDS; i++)
+		frame[i] = id * 1000 + depth * 10 + i;
+
+	if (depth > 0)
+		nest(id, depth - 1, round);
+	else if (round % 2)
+		uthread_yield();
+	else
+	{
+		sem_up(sems[(id + 1) % NR_SHARED]);
+		sem_down(sems[id]);
+	}
+
+	for (int i = 0; i < FRAME_WORDS; i++)
+		if (frame[i] != id * 1000 + depth * 10 + i)
+			nr_corrupted++;
+}
+
+static void shared_thread(void *arg)
+{
+	int id = (int)(long)arg;
+
+	for (int round = 0; round < NR_ROUNDS; round++)
+		nest(id, id % 8, round);
+	nr_done++;
+	// Let the others finish their last round
+	sem_up(sems[(id + 1) % NR_SHARED]);
+}
+
+static void private_thread(void *arg)
+{
+	(void)arg;
+
+	while (nr_done < NR_SHARED)
+		uthread_yield();
+}
+
+static void spawner(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	uthread_attr_init(&attr);
+	attr.stack_flags = UTHREAD_STACK_SHARED | UTHREAD_STACK_GROWABLE;
+	TEST_ASSERT(uthread_create_attr(shared_thread, NULL, &attr, NULL) == -1);
+
+	attr.stack_flags = UTHREAD_STACK_SHARED;
+	for (long i = 0; i < NR_SHARED; i++)
+	{
+		if (i % (NR_SHARED / NR_PRIVATE) == 0)
+			uthread_create(private_thread, NULL);
+		if (uthread_create_attr(shared_thread, (void *)i, &attr, NULL))
+			nr_corrupted++;
+	}
+}
+
+int main(void)
+{
+	struct uthread_stats stats;
+
+	// The shared stack freed at the end of a run is allocated again
+	for (int run = 0; run < 2; run++)
+	{
+		for (int i = 0; i < NR_SHARED; i++)
+			sems[i] = sem_create(0);
+		nr_done = 0;
+
+		uthread_run(false, spawner, NULL);
+
+		uthread_stats(&stats);
+		TEST_ASSERT(nr_done == NR_SHARED);
+		TEST_ASSERT(nr_corrupted == 0);
+		TEST_ASSERT(stats.nr_exited == NR_SHARED + NR_PRIVATE + 1);
+
+		for (int i = 0; i < NR_SHARED; i++)
+			sem_destroy(sems[i]);
+	}
+
+	return 0;
+}
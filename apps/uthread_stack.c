@@ -0,0 +1,105 @@
+/*
+ * Stack usage and stack size test
+ *
+ * Run threads using very different amounts of stack, some of them with a
+ * custom stack size, and check the measured usage is aggregated per thread
+ * function and lands in the right histogram buckets.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define SHALLOW_THREADS 4
+#define DEEP_BYTES (48 * 1024)
+#define DEEP_STACK_SIZE (64 * 1024)
+
+static void shallow(void *arg)
+{
+	(void)arg;
+}
+
+static void deep(void *arg)
+{
+	volatile char buf[DEEP_BYTES];
+	(void)arg;
+
+	for (size_t i = 0; i < sizeof(buf); i++)
+		buf[i] = 1;
+	uthread_yield();
+}
+
+static void spawner(void *arg)
+{
+	uthread_attr_t attr;
+	int tid = -1;
+	(void)arg;
+
+	for (int i = 0; i < SHALLOW_THREADS; i++)
+		uthread_create(shallow, NULL);
+
+	TEST_ASSERT(uthread_attr_init(&attr) == 0);
+	attr.stack_size = UTHREAD_STACK_MIN - 1;
+	TEST_ASSERT(uthread_create_attr(deep, NULL, &attr, &tid) == -1);
+	attr.stack_size = DEEP_STACK_SIZE;
+	TEST_ASSERT(uthread_create_attr(deep, NULL, &attr, &tid) == 0);
+	TEST_ASSERT(tid == uthread_self() + SHALLOW_THREADS + 1);
+}
+
+int main(void)
+{
+	struct uthread_stack_usage usage[4];
+	int n;
+
+	TEST_ASSERT(uthread_attr_init(NULL) == -1);
+	TEST_ASSERT(uthread_stack_usage(NULL, 1) == -1);
+
+	// Not measured
+	uthread_run(false, spawner, NULL);
+	TEST_ASSERT(uthread_stack_usage(usage, 4) == 0);
+
+	uthread_stack_check(true);
+	uthread_run(false, spawner, NULL);
+	uthread_stack_check(false);
+
+	n = uthread_stack_usage(usage, 4);
+	TEST_ASSERT(n == 3);
+	// Entries come in order of first exit, and the spawner exits first
+	TEST_ASSERT(usage[0].func == spawner);
+	TEST_ASSERT(usage[0].nr_threads == 1);
+
+	TEST_ASSERT(usage[1].func == shallow);
+	TEST_ASSERT(usage[1].nr_threads == SHALLOW_THREADS);
+	TEST_ASSERT(usage[1].max_stack_size == 32768);
+	TEST_ASSERT(usage[1].max_used > 0 && usage[1].max_used < 4096);
+
+	TEST_ASSERT(usage[2].func == deep);
+	TEST_ASSERT(usage[2].nr_threads == 1);
+	TEST_ASSERT(usage[2].max_stack_size == DEEP_STACK_SIZE);
+	TEST_ASSERT(usage[2].max_used >= DEEP_BYTES);
+	TEST_ASSERT(usage[2].max_used < DEEP_STACK_SIZE);
+	// 48 KiB and more, but less than 64 KiB
+	TEST_ASSERT(usage[2].hist[6] == 1);
+
+	TEST_ASSERT(uthread_stack_usage(usage, 1) == 1);
+	uthread_stack_usage_reset();
+	TEST_ASSERT(uthread_stack_usage(usage, 4) == 0);
+
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * Scheduler statistics test
+ *
+ * Two threads yield to each other a known number of times, one of them also
+ * blocking once on a semaphore, then the statistics of the runtime and of each
+ * thread, and the latency histograms, are checked against what the scheduler
+ * must have done. With preemption, a thread spinning without ever yielding
+ * must be accounted for as preempted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define NR_YIELDS 10
+
+static sem_t sem;
+static volatile int stop;
+static unsigned long nr_preempted;
+
+static void thread2(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < NR_YIELDS; i++)
+		uthread_yield();
+	sem_up(sem);
+	// Let thread1 check the statistics while this thread is still alive
+	uthread_yield();
+}
+
+static void thread1(void *arg)
+{
+	struct uthread_thread_stats threads[4];
+	struct uthread_stats stats;
+	int n;
+	(void)arg;
+
+	TEST_ASSERT(uthread_self() == 1);
+	uthread_create(thread2, NULL);
+
+	sem_down(sem);
+
+	n = uthread_thread_stats(threads, 4);
+	TEST_ASSERT(n == 3);
+	TEST_ASSERT(threads[0].tid == 0 && threads[0].func == NULL);
+	TEST_ASSERT(threads[1].tid == 1 && threads[1].func == thread1);
+	TEST_ASSERT(threads[2].tid == 2 && threads[2].func == thread2);
+	TEST_ASSERT(threads[1].nr_voluntary == 1);
+	TEST_ASSERT(threads[1].nr_scheduled == 2);
+	TEST_ASSERT(threads[2].nr_scheduled == NR_YIELDS + 1);
+	TEST_ASSERT(threads[1].blocked_ns > 0);
+	TEST_ASSERT(threads[1].run_ns > 0);
+
+	uthread_stats(&stats);
+	TEST_ASSERT(stats.nr_created == 2);
+	TEST_ASSERT(stats.nr_exited == 0);
+	TEST_ASSERT(stats.nr_threads == 3);
+	TEST_ASSERT(stats.sem_contended == 1);
+	TEST_ASSERT(stats.run_queue_hwm == 2);
+	TEST_ASSERT(stats.nr_switches > 2 * NR_YIELDS);
+}
+
+static void test_latency(struct uthread_stats *stats)
+{
+	struct uthread_latency lat;
+	unsigned long long ns;
+
+	TEST_ASSERT(uthread_latency(UTHREAD_LATENCY_READY, &lat) == 0);
+	TEST_ASSERT(lat.count == stats->nr_switches);
+	TEST_ASSERT(lat.min_ns <= lat.p50_ns && lat.p50_ns <= lat.p99_ns);
+	TEST_ASSERT(lat.p99_ns <= lat.max_ns);
+	TEST_ASSERT(uthread_latency_percentile(UTHREAD_LATENCY_READY, 100, &ns) == 0);
+	TEST_ASSERT(ns == lat.max_ns);
+
+	TEST_ASSERT(uthread_latency(UTHREAD_LATENCY_WAKEUP, &lat) == 0);
+	TEST_ASSERT(lat.count == 1);
+	TEST_ASSERT(uthread_latency(UTHREAD_LATENCY_BLOCKED, &lat) == 0);
+	TEST_ASSERT(lat.count == 1 && lat.min_ns == lat.max_ns);
+	TEST_ASSERT(lat.p50_ns <= lat.max_ns && lat.p50_ns >= lat.max_ns / 16 * 15);
+
+	TEST_ASSERT(uthread_latency_reset(UTHREAD_LATENCY_BLOCKED) == 0);
+	TEST_ASSERT(uthread_latency(UTHREAD_LATENCY_BLOCKED, &lat) == 0);
+	TEST_ASSERT(lat.count == 0 && lat.p99_ns == 0);
+	TEST_ASSERT(uthread_latency(UTHREAD_LATENCY_MAX, &lat) == -1);
+}
+
+static void stopper(void *arg)
+{
+	(void)arg;
+
+	stop = 1;
+}
+
+static void spinner(void *arg)
+{
+	struct uthread_thread_stats threads[3];
+	int n;
+	(void)arg;
+
+	uthread_create(stopper, NULL);
+	// Only preemption lets the stopper run
+	while (!stop)
+		;
+
+	n = uthread_thread_stats(threads, 3);
+	for (int i = 0; i < n; i++)
+		if (threads[i].func == spinner)
+			nr_preempted = threads[i].nr_preempted;
+}
+
+int main(void)
+{
+	struct uthread_stats stats;
+
+	TEST_ASSERT(uthread_self() == -1);
+
+	sem = sem_create(0);
+	uthread_run(false, thread1, NULL);
+	sem_destroy(sem);
+
+	uthread_stats(&stats);
+	TEST_ASSERT(stats.nr_exited == 2);
+	TEST_ASSERT(stats.nr_threads == 0);
+	TEST_ASSERT(stats.elapsed_ns > 0);
+
+	test_latency(&stats);
+
+	TEST_ASSERT(uthread_run(true, spinner, NULL) == 0);
+	TEST_ASSERT(nr_preempted > 0);
+
+	return 0;
+}
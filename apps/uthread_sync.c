@@ -0,0 +1,227 @@
+/*
+ * Wait groups, barriers, latches and once-initialization test
+ *
+ * Each primitive holds several threads, then releases them all at once: check
+ * none of them goes through too early, and that they are all woken up in bulk.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sync.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define NR_THREADS 8
+#define NR_PHASES 10
+
+static waitgroup_t wg;
+static barrier_t barrier;
+static latch_t latch;
+static once_t init_once = ONCE_INIT;
+
+static int nr_done;
+static int nr_through;
+static int phases[NR_THREADS];
+static int nr_serial;
+static int nr_init;
+static bool phases_ok = true;
+
+static unsigned long bulk_woken(void)
+{
+	struct uthread_stats stats;
+
+	uthread_stats(&stats);
+	return stats.nr_bulk_woken;
+}
+
+static void worker(void *arg)
+{
+	(void)arg;
+
+	uthread_yield();
+	nr_done++;
+	waitgroup_done(wg);
+}
+
+static void wg_waiter(void *arg)
+{
+	(void)arg;
+
+	waitgroup_wait(wg);
+	if (nr_done == NR_THREADS)
+		nr_through++;
+}
+
+static void test_waitgroup(void)
+{
+	unsigned long woken = bulk_woken();
+
+	TEST_ASSERT(waitgroup_add(wg, -1) == -1);
+	TEST_ASSERT(waitgroup_done(wg) == -1);
+	TEST_ASSERT(waitgroup_wait(wg) == 0);
+
+	TEST_ASSERT(waitgroup_add(wg, NR_THREADS) == 0);
+	for (int i = 0; i < NR_THREADS; i++)
+		uthread_create(worker, NULL);
+	uthread_create(wg_waiter, NULL);
+	uthread_create(wg_waiter, NULL);
+	TEST_ASSERT(waitgroup_wait(wg) == 0);
+	TEST_ASSERT(nr_done == NR_THREADS);
+	TEST_ASSERT(bulk_woken() - woken == 3);
+	uthread_yield();
+	TEST_ASSERT(nr_through == 2);
+	TEST_ASSERT(waitgroup_destroy(wg) == 0);
+}
+
+static void phaser(void *arg)
+{
+	int id = *(int *)arg;
+
+	for (int phase = 0; phase < NR_PHASES; phase++)
+	{
+		phases[id] = phase;
+		if (barrier_wait(barrier) == 1)
+			nr_serial++;
+		// Nobody can be a phase behind once through
+		for (int i = 0; i < NR_THREADS; i++)
+			if (phases[i] < phase)
+				phases_ok = false;
+		uthread_yield();
+	}
+}
+
+static void test_barrier(void)
+{
+	int ids[NR_THREADS];
+	unsigned long woken = bulk_woken();
+
+	TEST_ASSERT(barrier_create(0) == NULL);
+	for (int i = 0; i < NR_THREADS; i++)
+	{
+		ids[i] = i;
+		uthread_create(phaser, &ids[i]);
+	}
+	// Let all of them go through every phase
+	for (int i = 0; i < 4 * NR_PHASES; i++)
+		uthread_yield();
+	TEST_ASSERT(phases_ok);
+	TEST_ASSERT(nr_serial == NR_PHASES);
+	TEST_ASSERT(bulk_woken() - woken == NR_PHASES * (NR_THREADS - 1));
+	TEST_ASSERT(barrier_destroy(barrier) == 0);
+}
+
+static void latch_waiter(void *arg)
+{
+	(void)arg;
+
+	latch_wait(latch);
+	nr_through++;
+}
+
+static void test_latch(void)
+{
+	nr_through = 0;
+	for (int i = 0; i < NR_THREADS; i++)
+		uthread_create(latch_waiter, NULL);
+	uthread_yield();
+	TEST_ASSERT(latch_count_down(latch) == 0);
+	TEST_ASSERT(latch_count_down(latch) == 0);
+	uthread_yield();
+	TEST_ASSERT(nr_through == 0);
+	TEST_ASSERT(latch_destroy(latch) == -1);
+	TEST_ASSERT(latch_count_down(latch) == 0);
+	TEST_ASSERT(latch_count_down(latch) == -1);
+	uthread_yield();
+	TEST_ASSERT(nr_through == NR_THREADS);
+	TEST_ASSERT(latch_wait(latch) == 0);
+	TEST_ASSERT(latch_destroy(latch) == 0);
+}
+
+static void init(void)
+{
+	// Let the others pile up meanwhile
+	uthread_yield();
+	nr_init++;
+}
+
+static void once_caller(void *arg)
+{
+	(void)arg;
+
+	once(&init_once, init);
+	if (nr_init == 1)
+		nr_through++;
+}
+
+static void test_once(void)
+{
+	nr_through = 0;
+	for (int i = 0; i < NR_THREADS; i++)
+		uthread_create(once_caller, NULL);
+	// Once to start, once for init() to complete, once for the waiters
+	for (int i = 0; i < 3; i++)
+		uthread_yield();
+	TEST_ASSERT(nr_init == 1);
+	TEST_ASSERT(nr_through == NR_THREADS);
+	TEST_ASSERT(init_once.waiters == NULL);
+	TEST_ASSERT(once(&init_once, init) == 0);
+	TEST_ASSERT(nr_init == 1);
+}
+
+static void test_cancel(void)
+{
+	latch = latch_create(1);
+	barrier = barrier_create(1);
+	TEST_ASSERT(barrier_wait(barrier) == 1);
+	uthread_cancel(uthread_self());
+	errno = 0;
+	TEST_ASSERT(latch_wait(latch) == -1 && errno == ECANCELED);
+	TEST_ASSERT(barrier_wait(barrier) == -1);
+	TEST_ASSERT(latch_destroy(latch) == 0);
+	TEST_ASSERT(barrier_destroy(barrier) == 0);
+}
+
+static void test_sync(void *arg)
+{
+	(void)arg;
+
+	test_waitgroup();
+	test_barrier();
+	test_latch();
+	test_once();
+	test_cancel();
+}
+
+int main(void)
+{
+	TEST_ASSERT(waitgroup_destroy(NULL) == -1);
+	TEST_ASSERT(once(NULL, NULL) == -1);
+
+	wg = waitgroup_create();
+	barrier = barrier_create(NR_THREADS);
+	latch = latch_create(3);
+	TEST_ASSERT(uthread_run(false, test_sync, NULL) == 0);
+
+	// A latch created open never blocks, even outside of uthread_run()
+	latch = latch_create(0);
+	TEST_ASSERT(latch_wait(latch) == 0);
+	TEST_ASSERT(latch_destroy(latch) == 0);
+
+	return 0;
+}
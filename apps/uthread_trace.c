@@ -0,0 +1,118 @@
+/*
+ * Scheduling trace test
+ *
+ * Record the scheduling events of two threads exchanging a few values through
+ * semaphores, dump them as a Chrome trace and check the expected events made
+ * it to the file. Then do it again with a ring buffer too small to hold all
+ * the events.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)                 \
+	do                                      \
+	{                                       \
+		printf("ASSERT: " #assert " ... "); \
+		if (assert)                         \
+		{                                   \
+			printf("PASS\n");               \
+		}                                   \
+		else                                \
+		{                                   \
+			printf("FAIL\n");               \
+			exit(1);                        \
+		}                                   \
+	} while (0)
+
+#define TRACE_PATH "uthread_trace.json"
+#define NR_ROUNDS 5
+
+static sem_t ping, pong;
+
+static void thread2(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < NR_ROUNDS; i++)
+	{
+		sem_down(ping);
+		sem_up(pong);
+	}
+}
+
+static void thread1(void *arg)
+{
+	(void)arg;
+
+	uthread_create(thread2, NULL);
+	for (int i = 0; i < NR_ROUNDS; i++)
+	{
+		sem_up(ping);
+		sem_down(pong);
+	}
+}
+
+static char *read_file(const char *path)
+{
+	static char buf[1 << 16];
+	FILE *f = fopen(path, "r");
+	size_t n;
+
+	if (!f)
+		return NULL;
+	n = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[n] = '\0';
+	fclose(f);
+	return buf;
+}
+
+int main(void)
+{
+	char *trace;
+
+	TEST_ASSERT(uthread_trace_dump(TRACE_PATH) == -1);
+	TEST_ASSERT(uthread_trace_start(0) == -1);
+
+	ping = sem_create(0);
+	pong = sem_create(0);
+
+	TEST_ASSERT(uthread_trace_start(1024) == 0);
+	uthread_run(false, thread1, NULL);
+	uthread_trace_stop();
+	TEST_ASSERT(uthread_trace_dump(TRACE_PATH) == 0);
+
+	trace = read_file(TRACE_PATH);
+	TEST_ASSERT(trace != NULL);
+	TEST_ASSERT(strncmp(trace, "{\"displayTimeUnit\"", 18) == 0);
+	TEST_ASSERT(strstr(trace, "\"tid\":0,\"args\":{\"name\":\"idle\"}") != NULL);
+	TEST_ASSERT(strstr(trace, "\"name\":\"uthread 2\"") != NULL);
+	TEST_ASSERT(strstr(trace, "\"name\":\"running\"") != NULL);
+	TEST_ASSERT(strstr(trace, "\"name\":\"create\"") != NULL);
+	TEST_ASSERT(strstr(trace, "\"name\":\"sem_wait\"") != NULL);
+	TEST_ASSERT(strstr(trace, "\"name\":\"unblock\"") != NULL);
+	TEST_ASSERT(strstr(trace, "\"name\":\"exit\"") != NULL);
+	TEST_ASSERT(strcmp(trace + strlen(trace) - 4, "\n]}\n") == 0);
+
+	TEST_ASSERT(uthread_trace_start(4) == 0);
+	uthread_run(false, thread1, NULL);
+	TEST_ASSERT(uthread_trace_dump(TRACE_PATH) == 0);
+	uthread_trace_stop();
+
+	trace = read_file(TRACE_PATH);
+	TEST_ASSERT(trace != NULL);
+	TEST_ASSERT(strstr(trace, "\"name\":\"create\"") == NULL);
+	TEST_ASSERT(strstr(trace, "\"name\":\"idle\"") != NULL);
+	TEST_ASSERT(strstr(trace, "\"tid\":0,") == NULL);
+	TEST_ASSERT(strstr(trace, "\"name\":\"exit\"") != NULL);
+
+	remove(TRACE_PATH);
+	sem_destroy(ping);
+	sem_destroy(pong);
+
+	return 0;
+}
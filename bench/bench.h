@@ -0,0 +1,176 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+/*
+ * Helpers shared by the benchmark programs: timing, sample collection,
+ * percentiles and reporting as a text table, CSV or JSON.
+ *
+ * A benchmark collects samples in ns/op (usually the mean of a small batch of
+ * operations, so that reading the clock does not dominate the measure) and
+ * reports them together with the total number of operations and the total
+ * elapsed time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum
+{
+	BENCH_TEXT,
+	BENCH_CSV,
+	BENCH_JSON,
+} bench_format_t;
+
+struct bench_samples
+{
+	double *v;
+	size_t n;
+	size_t cap;
+};
+
+struct bench_result
+{
+	const char *name;
+	int threads;
+	unsigned long ops;
+	unsigned long long elapsed_ns;
+	struct bench_samples *samples;
+	long rss_kb; /* only reported if bench_show_rss is set */
+};
+
+static inline unsigned long long bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void bench_samples_add(struct bench_samples *s, double ns)
+{
+	if (s->n == s->cap)
+	{
+		s->cap = s->cap ? 2 * s->cap : 1024;
+		s->v = realloc(s->v, s->cap * sizeof(double));
+		if (!s->v)
+		{
+			perror("realloc");
+			exit(1);
+		}
+	}
+	s->v[s->n++] = ns;
+}
+
+static inline void bench_samples_reset(struct bench_samples *s)
+{
+	s->n = 0;
+}
+
+static int bench_double_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile, @s must be sorted */
+static inline double bench_percentile(struct bench_samples *s, double p)
+{
+	if (!s->n)
+		return 0;
+	size_t rank = (size_t)(p / 100 * s->n + 0.5);
+	if (rank == 0)
+		rank = 1;
+	if (rank > s->n)
+		rank = s->n;
+	return s->v[rank - 1];
+}
+
+static bench_format_t bench_format = BENCH_TEXT;
+static int bench_show_rss;
+static int bench_nr_reported;
+
+static inline int bench_parse_format(const char *arg)
+{
+	if (!strcmp(arg, "text"))
+		bench_format = BENCH_TEXT;
+	else if (!strcmp(arg, "csv"))
+		bench_format = BENCH_CSV;
+	else if (!strcmp(arg, "json"))
+		bench_format = BENCH_JSON;
+	else
+		return -1;
+	return 0;
+}
+
+static inline void bench_report_begin(void)
+{
+	bench_nr_reported = 0;
+	switch (bench_format)
+	{
+	case BENCH_TEXT:
+		printf("%-24s %8s %10s %10s %10s %10s %10s %10s %12s", "benchmark",
+			   "threads", "ops", "mean", "p50", "p90", "p99", "max", "ops/s");
+		printf(bench_show_rss ? " %10s\n" : "\n", "rss_kb");
+		break;
+	case BENCH_CSV:
+		printf("benchmark,threads,ops,mean_ns,p50_ns,p90_ns,p99_ns,max_ns,"
+			   "ops_per_sec");
+		printf(bench_show_rss ? ",rss_kb\n" : "\n");
+		break;
+	case BENCH_JSON:
+		printf("[\n");
+		break;
+	}
+}
+
+static inline void bench_report(struct bench_result *r)
+{
+	struct bench_samples *s = r->samples;
+	double mean = r->ops ? (double)r->elapsed_ns / r->ops : 0;
+	double rate = r->elapsed_ns ? r->ops * 1e9 / r->elapsed_ns : 0;
+
+	qsort(s->v, s->n, sizeof(double), bench_double_cmp);
+	double p50 = bench_percentile(s, 50);
+	double p90 = bench_percentile(s, 90);
+	double p99 = bench_percentile(s, 99);
+	double max = s->n ? s->v[s->n - 1] : 0;
+
+	switch (bench_format)
+	{
+	case BENCH_TEXT:
+		printf("%-24s %8d %10lu %10.1f %10.1f %10.1f %10.1f %10.1f %12.0f",
+			   r->name, r->threads, r->ops, mean, p50, p90, p99, max, rate);
+		if (bench_show_rss)
+			printf(" %10ld", r->rss_kb);
+		printf("\n");
+		break;
+	case BENCH_CSV:
+		printf("%s,%d,%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%.0f", r->name,
+			   r->threads, r->ops, mean, p50, p90, p99, max, rate);
+		if (bench_show_rss)
+			printf(",%ld", r->rss_kb);
+		printf("\n");
+		break;
+	case BENCH_JSON:
+		printf("%s  {\"benchmark\": \"%s\", \"threads\": %d, \"ops\": %lu, "
+			   "\"mean_ns\": %.1f, \"p50_ns\": %.1f, \"p90_ns\": %.1f, "
+			   "\"p99_ns\": %.1f, \"max_ns\": %.1f, \"ops_per_sec\": %.0f",
+			   bench_nr_reported ? ",\n" : "", r->name, r->threads, r->ops,
+			   mean, p50, p90, p99, max, rate);
+		if (bench_show_rss)
+			printf(", \"rss_kb\": %ld", r->rss_kb);
+		printf("}");
+		break;
+	}
+	bench_nr_reported++;
+	fflush(stdout);
+}
+
+static inline void bench_report_end(void)
+{
+	if (bench_format == BENCH_JSON)
+		printf("\n]\n");
+}
+
+#endif /* _BENCH_H */
@@ -0,0 +1,781 @@
+/*
+ * Comparison benchmark against kernel threads
+ *
+ * Run the same workloads on top of libuthread and on top of one pthread per
+ * task synchronized with futex-based semaphores, for growing numbers of
+ * concurrent tasks:
+ * - prodcons: pairs of producer/consumer tasks exchanging items through a
+ *             bounded buffer, as in apps/sem_buffer.c (ops are items, latency
+ *             is from production to consumption)
+ * - sieve:    the prime sieve pipeline of apps/sem_prime.c, with one filter
+ *             task per prime (ops are numbers fed to the pipeline, latency is
+ *             from the source to the sink)
+ * - echo:     pairs of client/server tasks echoing 64-byte messages over a
+ *             socketpair (ops are messages, latency is a round trip)
+ *
+ * Usage: compare_bench.x [-f text|csv|json] [-w prodcons|sieve|echo]
+ *                        [-i uthread|pthread] [-n ops] [-t max_tasks]
+ *
+ * Each configuration runs in its own child process so that the reported
+ * maximum RSS only accounts for that configuration.
+ *
+ * The kernel-thread flavor uses its own futex semaphore rather than POSIX
+ * sem_t, whose name clashes with libuthread's. On libuthread, sockets are
+ * non-blocking and a task that would block yields and retries, as there is no
+ * I/O poller in the library.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#include "bench.h"
+
+#define DEFAULT_OPS 100000
+#define DEFAULT_MAX_TASKS 1000
+#define BUFFER_SIZE 16
+#define MSG_SIZE 64
+#define PTHREAD_STACK_SIZE (64 * 1024)
+
+static unsigned long nr_ops = DEFAULT_OPS;
+
+/*
+ * Task runtime abstraction, so that each workload is written once
+ */
+struct impl
+{
+	const char *name;
+	bool nonblocking_io;
+	int (*run)(void (*func)(void *), void *arg);
+	int (*spawn)(void (*func)(void *), void *arg);
+	void (*yield)(void);
+	void *(*sem_new)(unsigned int count);
+	void (*sem_down)(void *sem);
+	void (*sem_up)(void *sem);
+	void (*sem_free)(void *sem);
+};
+
+/* libuthread */
+static int ut_run(void (*func)(void *), void *arg)
+{
+	return uthread_run(false, func, arg);
+}
+
+static void *ut_sem_new(unsigned int count)
+{
+	return sem_create(count);
+}
+
+static void ut_sem_down(void *sem)
+{
+	sem_down(sem);
+}
+
+static void ut_sem_up(void *sem)
+{
+	sem_up(sem);
+}
+
+static void ut_sem_free(void *sem)
+{
+	sem_destroy(sem);
+}
+
+static const struct impl uthread_impl = {
+	.name = "uthread",
+	.nonblocking_io = true,
+	.run = ut_run,
+	.spawn = uthread_create,
+	.yield = uthread_yield,
+	.sem_new = ut_sem_new,
+	.sem_down = ut_sem_down,
+	.sem_up = ut_sem_up,
+	.sem_free = ut_sem_free,
+};
+
+/* pthreads */
+struct fsem
+{
+	atomic_int count;
+	atomic_int waiters;
+};
+
+static void futex_wait(atomic_int *addr, int val)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_int *addr, int nr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, nr, NULL, NULL, 0);
+}
+
+static void *pt_sem_new(unsigned int count)
+{
+	struct fsem *s = malloc(sizeof(*s));
+	if (!s)
+		return NULL;
+	atomic_init(&s->count, count);
+	atomic_init(&s->waiters, 0);
+	return s;
+}
+
+static void pt_sem_down(void *sem)
+{
+	struct fsem *s = sem;
+
+	while (1)
+	{
+		int c = atomic_load(&s->count);
+		while (c > 0)
+			if (atomic_compare_exchange_weak(&s->count, &c, c - 1))
+				return;
+		atomic_fetch_add(&s->waiters, 1);
+		futex_wait(&s->count, 0);
+		atomic_fetch_sub(&s->waiters, 1);
+	}
+}
+
+static void pt_sem_up(void *sem)
+{
+	struct fsem *s = sem;
+
+	atomic_fetch_add(&s->count, 1);
+	if (atomic_load(&s->waiters))
+		futex_wake(&s->count, 1);
+}
+
+static void pt_sem_free(void *sem)
+{
+	free(sem);
+}
+
+static atomic_int pt_live;
+
+struct pt_start
+{
+	void (*func)(void *);
+	void *arg;
+};
+
+static void *pt_trampoline(void *arg)
+{
+	struct pt_start start = *(struct pt_start *)arg;
+
+	free(arg);
+	start.func(start.arg);
+	if (atomic_fetch_sub(&pt_live, 1) == 1)
+		futex_wake(&pt_live, 1);
+	return NULL;
+}
+
+static int pt_spawn(void (*func)(void *), void *arg)
+{
+	struct pt_start *start = malloc(sizeof(*start));
+	pthread_attr_t attr;
+	pthread_t thread;
+	int ret;
+
+	if (!start)
+		return -1;
+	start->func = func;
+	start->arg = arg;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_attr_setstacksize(&attr, PTHREAD_STACK_SIZE);
+	atomic_fetch_add(&pt_live, 1);
+	ret = pthread_create(&thread, &attr, pt_trampoline, start);
+	pthread_attr_destroy(&attr);
+	if (ret)
+	{
+		atomic_fetch_sub(&pt_live, 1);
+		free(start);
+		errno = ret;
+		return -1;
+	}
+	return 0;
+}
+
+static int pt_run(void (*func)(void *), void *arg)
+{
+	int live;
+
+	if (pt_spawn(func, arg))
+		return -1;
+	while ((live = atomic_load(&pt_live)) != 0)
+		futex_wait(&pt_live, live);
+	return 0;
+}
+
+static void pt_yield(void)
+{
+	sched_yield();
+}
+
+static const struct impl pthread_impl = {
+	.name = "pthread",
+	.nonblocking_io = false,
+	.run = pt_run,
+	.spawn = pt_spawn,
+	.yield = pt_yield,
+	.sem_new = pt_sem_new,
+	.sem_down = pt_sem_down,
+	.sem_up = pt_sem_up,
+	.sem_free = pt_sem_free,
+};
+
+static const struct impl *impl;
+
+static void spawn_or_die(void (*func)(void *), void *arg)
+{
+	if (impl->spawn(func, arg))
+	{
+		perror("spawn");
+		exit(1);
+	}
+}
+
+/*
+ * Producer/consumer
+ */
+struct pair
+{
+	void *empty;
+	void *full;
+	void *mutex;
+	size_t size, head, tail;
+	unsigned long items;
+	unsigned long long buffer[BUFFER_SIZE];
+	struct bench_samples samples;
+};
+
+struct prodcons
+{
+	struct pair *pairs;
+	int nr_pairs;
+};
+
+static void consumer(void *arg)
+{
+	struct pair *p = arg;
+
+	for (unsigned long i = 0; i < p->items; i++)
+	{
+		impl->sem_down(p->empty);
+		unsigned long long stamp = p->buffer[p->tail];
+		p->tail = (p->tail + 1) % BUFFER_SIZE;
+		impl->sem_down(p->mutex);
+		p->size--;
+		impl->sem_up(p->mutex);
+		impl->sem_up(p->full);
+		bench_samples_add(&p->samples, bench_now_ns() - stamp);
+	}
+}
+
+static void producer(void *arg)
+{
+	struct pair *p = arg;
+
+	for (unsigned long i = 0; i < p->items; i++)
+	{
+		impl->sem_down(p->full);
+		p->buffer[p->head] = bench_now_ns();
+		p->head = (p->head + 1) % BUFFER_SIZE;
+		impl->sem_down(p->mutex);
+		p->size++;
+		impl->sem_up(p->mutex);
+		impl->sem_up(p->empty);
+	}
+}
+
+static void prodcons_main(void *arg)
+{
+	struct prodcons *pc = arg;
+
+	for (int i = 0; i < pc->nr_pairs; i++)
+	{
+		spawn_or_die(consumer, &pc->pairs[i]);
+		spawn_or_die(producer, &pc->pairs[i]);
+	}
+}
+
+static unsigned long run_prodcons(int tasks, struct bench_samples *samples)
+{
+	struct prodcons pc;
+	unsigned long items = nr_ops / (tasks / 2);
+
+	pc.nr_pairs = tasks / 2;
+	pc.pairs = calloc(pc.nr_pairs, sizeof(struct pair));
+	if (!items)
+		items = 1;
+	for (int i = 0; i < pc.nr_pairs; i++)
+	{
+		pc.pairs[i].empty = impl->sem_new(0);
+		pc.pairs[i].full = impl->sem_new(BUFFER_SIZE);
+		pc.pairs[i].mutex = impl->sem_new(1);
+		pc.pairs[i].items = items;
+	}
+
+	if (impl->run(prodcons_main, &pc))
+	{
+		perror("run");
+		exit(1);
+	}
+
+	for (int i = 0; i < pc.nr_pairs; i++)
+	{
+		struct pair *p = &pc.pairs[i];
+		for (size_t j = 0; j < p->samples.n; j++)
+			bench_samples_add(samples, p->samples.v[j]);
+		free(p->samples.v);
+		impl->sem_free(p->empty);
+		impl->sem_free(p->full);
+		impl->sem_free(p->mutex);
+	}
+	free(pc.pairs);
+	return items * (tasks / 2);
+}
+
+/*
+ * Prime sieve
+ */
+struct channel
+{
+	int value;
+	unsigned long long stamp;
+	void *produce;
+	void *consume;
+};
+
+struct filter
+{
+	struct channel *left;
+	struct channel *right;
+	int prime;
+};
+
+struct sieve
+{
+	int max;
+	int nr_filters;
+	struct bench_samples *samples;
+	/*
+	 * Channels are only freed once every task is done: with kernel threads,
+	 * the receiver of the last value cannot tell when the sender is really
+	 * out of sem_up()
+	 */
+	struct channel **channels;
+	int nr_channels;
+};
+
+static struct channel *channel_new(struct sieve *s)
+{
+	struct channel *c = malloc(sizeof(*c));
+	c->produce = impl->sem_new(0);
+	c->consume = impl->sem_new(0);
+	s->channels[s->nr_channels++] = c;
+	return c;
+}
+
+static void channel_free(struct channel *c)
+{
+	impl->sem_free(c->produce);
+	impl->sem_free(c->consume);
+	free(c);
+}
+
+static void channel_send(struct channel *c, int value,
+						 unsigned long long stamp)
+{
+	c->value = value;
+	c->stamp = stamp;
+	impl->sem_up(c->consume);
+	impl->sem_down(c->produce);
+}
+
+static int channel_recv(struct channel *c, unsigned long long *stamp)
+{
+	impl->sem_down(c->consume);
+	int value = c->value;
+	*stamp = c->stamp;
+	impl->sem_up(c->produce);
+	return value;
+}
+
+static void source(void *arg)
+{
+	struct channel *c = arg;
+	int max = c->value;
+
+	for (int i = 2; i <= max; i++)
+		channel_send(c, i, bench_now_ns());
+	channel_send(c, -1, 0);
+}
+
+static void filter(void *arg)
+{
+	struct filter *f = arg;
+	unsigned long long stamp;
+	int value;
+
+	do
+	{
+		value = channel_recv(f->left, &stamp);
+		if (value == -1 || value % f->prime != 0)
+			channel_send(f->right, value, stamp);
+	} while (value != -1);
+
+	free(f);
+}
+
+static void sink(void *arg)
+{
+	struct sieve *s = arg;
+	struct channel *c = channel_new(s);
+	unsigned long long stamp;
+	int value;
+
+	c->value = s->max;
+	spawn_or_die(source, c);
+
+	while ((value = channel_recv(c, &stamp)) != -1)
+	{
+		bench_samples_add(s->samples, bench_now_ns() - stamp);
+		if (s->nr_filters == 0)
+			continue;
+
+		// Not divisible by any known prime so far: new prime, new filter
+		struct filter *f = malloc(sizeof(*f));
+		f->left = c;
+		f->prime = value;
+		f->right = c = channel_new(s);
+		spawn_or_die(filter, f);
+		s->nr_filters--;
+	}
+}
+
+static unsigned long run_sieve(int tasks, struct bench_samples *samples)
+{
+	// One task is the source, one the sink, the rest are filters
+	int nr_filters = tasks > 2 ? tasks - 2 : 1;
+	// Upper bound of the nr_filters-th prime
+	double n = nr_filters < 6 ? 6 : nr_filters;
+	struct sieve s = {(int)(n * (log(n) + log(log(n)))), nr_filters, samples,
+					  malloc((nr_filters + 1) * sizeof(struct channel *)), 0};
+
+	if (impl->run(sink, &s))
+	{
+		perror("run");
+		exit(1);
+	}
+
+	for (int i = 0; i < s.nr_channels; i++)
+		channel_free(s.channels[i]);
+	free(s.channels);
+	return s.max - 1;
+}
+
+/*
+ * Echo over socketpairs
+ */
+struct conn
+{
+	int fds[2];
+	unsigned long messages;
+	struct bench_samples samples;
+};
+
+struct echo
+{
+	struct conn *conns;
+	int nr_conns;
+};
+
+static ssize_t io_read(int fd, char *buf, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len)
+	{
+		ssize_t ret = read(fd, buf + done, len - done);
+		if (ret == 0)
+			return done;
+		if (ret < 0)
+		{
+			if (errno == EAGAIN && impl->nonblocking_io)
+			{
+				impl->yield();
+				continue;
+			}
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		done += ret;
+	}
+	return done;
+}
+
+static ssize_t io_write(int fd, const char *buf, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len)
+	{
+		ssize_t ret = write(fd, buf + done, len - done);
+		if (ret < 0)
+		{
+			if (errno == EAGAIN && impl->nonblocking_io)
+			{
+				impl->yield();
+				continue;
+			}
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		done += ret;
+	}
+	return done;
+}
+
+static void echo_server(void *arg)
+{
+	struct conn *c = arg;
+	char buf[MSG_SIZE];
+
+	while (io_read(c->fds[1], buf, MSG_SIZE) == MSG_SIZE)
+		io_write(c->fds[1], buf, MSG_SIZE);
+	close(c->fds[1]);
+}
+
+static void echo_client(void *arg)
+{
+	struct conn *c = arg;
+	char buf[MSG_SIZE] = {0};
+
+	for (unsigned long i = 0; i < c->messages; i++)
+	{
+		unsigned long long start = bench_now_ns();
+		if (io_write(c->fds[0], buf, MSG_SIZE) != MSG_SIZE ||
+			io_read(c->fds[0], buf, MSG_SIZE) != MSG_SIZE)
+		{
+			perror("echo");
+			exit(1);
+		}
+		bench_samples_add(&c->samples, bench_now_ns() - start);
+	}
+	close(c->fds[0]);
+}
+
+static void echo_main(void *arg)
+{
+	struct echo *e = arg;
+
+	for (int i = 0; i < e->nr_conns; i++)
+	{
+		spawn_or_die(echo_server, &e->conns[i]);
+		spawn_or_die(echo_client, &e->conns[i]);
+	}
+}
+
+static unsigned long run_echo(int tasks, struct bench_samples *samples)
+{
+	struct echo e;
+	unsigned long messages = nr_ops / (tasks / 2);
+	int type = SOCK_STREAM;
+
+	if (!messages)
+		messages = 1;
+	if (impl->nonblocking_io)
+		type |= SOCK_NONBLOCK;
+
+	e.nr_conns = tasks / 2;
+	e.conns = calloc(e.nr_conns, sizeof(struct conn));
+	for (int i = 0; i < e.nr_conns; i++)
+	{
+		if (socketpair(AF_UNIX, type, 0, e.conns[i].fds))
+		{
+			perror("socketpair");
+			exit(1);
+		}
+		e.conns[i].messages = messages;
+	}
+
+	if (impl->run(echo_main, &e))
+	{
+		perror("run");
+		exit(1);
+	}
+
+	for (int i = 0; i < e.nr_conns; i++)
+	{
+		struct conn *c = &e.conns[i];
+		for (size_t j = 0; j < c->samples.n; j++)
+			bench_samples_add(samples, c->samples.v[j]);
+		free(c->samples.v);
+	}
+	free(e.conns);
+	return messages * (tasks / 2);
+}
+
+/*
+ * Driver
+ */
+struct workload
+{
+	const char *name;
+	unsigned long (*run)(int tasks, struct bench_samples *samples);
+};
+
+static const struct workload workloads[] = {
+	{"prodcons", run_prodcons},
+	{"sieve", run_sieve},
+	{"echo", run_echo},
+};
+
+static const struct impl *impls[] = {&uthread_impl, &pthread_impl};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* Run one configuration in a child process, return 0 if it succeeded */
+static int bench_one(const struct workload *w, const struct impl *i, int tasks)
+{
+	pid_t pid;
+	int status;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0)
+	{
+		perror("fork");
+		return -1;
+	}
+
+	if (pid == 0)
+	{
+		static char name[64];
+		struct bench_samples samples = {0};
+		struct bench_result r = {.name = name, .threads = tasks,
+								 .samples = &samples};
+		struct rusage ru;
+		unsigned long long start;
+
+		impl = i;
+		snprintf(name, sizeof(name), "%s/%s", w->name, i->name);
+		start = bench_now_ns();
+		r.ops = w->run(tasks, &samples);
+		r.elapsed_ns = bench_now_ns() - start;
+		getrusage(RUSAGE_SELF, &ru);
+		r.rss_kb = ru.ru_maxrss;
+		bench_report(&r);
+		exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+		WEXITSTATUS(status))
+	{
+		fprintf(stderr, "%s/%s with %d tasks failed\n", w->name, i->name,
+				tasks);
+		return -1;
+	}
+	bench_nr_reported++;
+	return 0;
+}
+
+static unsigned long get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX || ret <= 0)
+	{
+		fprintf(stderr, "invalid number: %s\n", argv);
+		exit(1);
+	}
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-f text|csv|json] [-w prodcons|sieve|echo] "
+					"[-i uthread|pthread] [-n ops] [-t max_tasks]\n",
+			prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *only_workload = NULL, *only_impl = NULL;
+	int max_tasks = DEFAULT_MAX_TASKS;
+	struct rlimit rl;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:w:i:n:t:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f':
+			if (bench_parse_format(optarg))
+				usage(argv[0]);
+			break;
+		case 'w':
+			only_workload = optarg;
+			break;
+		case 'i':
+			only_impl = optarg;
+			break;
+		case 'n':
+			nr_ops = get_argv(optarg);
+			break;
+		case 't':
+			max_tasks = get_argv(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	// Thousands of socketpairs need more descriptors than the usual default
+	if (!getrlimit(RLIMIT_NOFILE, &rl))
+	{
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	bench_show_rss = 1;
+	bench_report_begin();
+	for (size_t w = 0; w < ARRAY_SIZE(workloads); w++)
+	{
+		if (only_workload && strcmp(only_workload, workloads[w].name))
+			continue;
+		for (int tasks = 10; tasks <= max_tasks; tasks *= 10)
+		{
+			for (size_t i = 0; i < ARRAY_SIZE(impls); i++)
+			{
+				if (only_impl && strcmp(only_impl, impls[i]->name))
+					continue;
+				bench_one(&workloads[w], impls[i], tasks);
+			}
+		}
+	}
+	bench_report_end();
+
+	return 0;
+}
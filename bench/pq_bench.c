@@ -0,0 +1,163 @@
+/*
+ * Priority queue benchmark
+ *
+ * Compare pq_t against the obvious alternative, a sorted linked list, on the
+ * two access patterns of a timer queue:
+ * - fill: insert n random keys, then extract them all
+ * - hold: keep n keys queued, and repeatedly extract the smallest one and
+ *   insert it back with a later key (what a periodic timer does)
+ *
+ * Usage: pq_bench.x [max_n]
+ * Prints one line per structure, pattern and size with the mean cost of one
+ * operation in nanoseconds.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pq.h>
+
+#define MAX_N 16384
+#define HOLD_OPS 20000
+
+struct item
+{
+	unsigned long key;
+	struct item *next;
+};
+
+static int item_cmp(const void *a, const void *b)
+{
+	const struct item *x = a, *y = b;
+	return (x->key > y->key) - (x->key < y->key);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Sorted singly linked list, smallest key first */
+static void list_insert(struct item **head, struct item *it)
+{
+	while (*head && (*head)->key <= it->key)
+		head = &(*head)->next;
+	it->next = *head;
+	*head = it;
+}
+
+static struct item *list_extract_min(struct item **head)
+{
+	struct item *it = *head;
+	*head = it->next;
+	return it;
+}
+
+static void bench_pq(struct item *items, size_t n, unsigned int seed)
+{
+	pq_t pq = pq_create(item_cmp);
+	struct item *it;
+	unsigned long long start;
+	size_t i;
+
+	start = now_ns();
+	for (i = 0; i < n; i++)
+		pq_insert(pq, &items[i], NULL);
+	for (i = 0; i < n; i++)
+		pq_extract_min(pq, (void **)&it);
+	printf("pq\tfill\t%zu\t%.1f\n", n, (double)(now_ns() - start) / (2 * n));
+
+	for (i = 0; i < n; i++)
+		pq_insert(pq, &items[i], NULL);
+	start = now_ns();
+	for (i = 0; i < HOLD_OPS; i++)
+	{
+		pq_extract_min(pq, (void **)&it);
+		it->key += rand_r(&seed) % (4 * n) + 1;
+		pq_insert(pq, it, NULL);
+	}
+	printf("pq\thold\t%zu\t%.1f\n", n,
+		   (double)(now_ns() - start) / (2 * HOLD_OPS));
+
+	while (pq_extract_min(pq, (void **)&it) == 0)
+		;
+	pq_destroy(pq);
+}
+
+static void bench_list(struct item *items, size_t n, unsigned int seed)
+{
+	struct item *head = NULL;
+	struct item *it;
+	unsigned long long start;
+	size_t i;
+
+	start = now_ns();
+	for (i = 0; i < n; i++)
+		list_insert(&head, &items[i]);
+	for (i = 0; i < n; i++)
+		list_extract_min(&head);
+	printf("list\tfill\t%zu\t%.1f\n", n, (double)(now_ns() - start) / (2 * n));
+
+	for (i = 0; i < n; i++)
+		list_insert(&head, &items[i]);
+	start = now_ns();
+	for (i = 0; i < HOLD_OPS; i++)
+	{
+		it = list_extract_min(&head);
+		it->key += rand_r(&seed) % (4 * n) + 1;
+		list_insert(&head, it);
+	}
+	printf("list\thold\t%zu\t%.1f\n", n,
+		   (double)(now_ns() - start) / (2 * HOLD_OPS));
+}
+
+static void reset_keys(struct item *items, size_t n, unsigned int seed)
+{
+	for (size_t i = 0; i < n; i++)
+		items[i].key = rand_r(&seed) % (4 * n);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX)
+	{
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	size_t max_n = MAX_N;
+	struct item *items;
+	size_t n;
+
+	if (argc > 1)
+		max_n = get_argv(argv[1]);
+
+	items = malloc(max_n * sizeof(*items));
+	if (!items)
+	{
+		perror("malloc");
+		return 1;
+	}
+
+	printf("struct\tpattern\tn\tns/op\n");
+	for (n = 16; n <= max_n; n *= 4)
+	{
+		reset_keys(items, n, 1);
+		bench_pq(items, n, 2);
+		reset_keys(items, n, 1);
+		bench_list(items, n, 2);
+	}
+
+	free(items);
+	return 0;
+}
@@ -0,0 +1,439 @@
+/*
+ * Scheduler microbenchmarks
+ *
+ * Measure the basic costs of the library, for several numbers of threads:
+ * - yield:          one context switch through uthread_yield(), with every
+ *                   thread yielding in turn
+ * - yield_preempt:  same as yield, with preemption enabled in uthread_run()
+ * - yield_shared:   same as yield, with the workers on the shared stack, so that
+ *                   every switch between them copies their stacks
+ * - sem_pingpong:   one round trip between two threads over two semaphores
+ * - gen_next:       one value passed from a generator to its consumer
+ * - coro_yield:     one resumption of a stackless coroutine, with that many
+ *                   coroutines yielding in turn
+ * - create_exit:    creating a thread that does nothing, running it and
+ *                   reclaiming it, with that many threads created at once
+ * - queue_enq_deq:  one enqueue plus one dequeue on a queue_t already holding
+ *                   that many items
+ *
+ * Usage: sched_bench.x [-f text|csv|json] [-n ops] [-t max_threads]
+ *
+ * Samples are the mean cost of a batch of operations, percentiles are computed
+ * over these batches.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <coro.h>
+#include <gen.h>
+#include <queue.h>
+#include <sem.h>
+#include <uthread.h>
+
+#include "bench.h"
+
+#define DEFAULT_OPS 200000
+#define DEFAULT_MAX_THREADS 1024
+#define BATCH 16
+
+static unsigned long nr_ops = DEFAULT_OPS;
+static struct bench_samples samples;
+
+/*
+ * Yield
+ */
+struct yield_bench
+{
+	int threads;
+	unsigned long rounds;
+	unsigned int stack_flags;
+};
+
+static void yield_worker(void *arg)
+{
+	struct yield_bench *b = arg;
+
+	for (unsigned long i = 0; i < b->rounds; i++)
+		uthread_yield();
+}
+
+/* First worker, also samples how long BATCH rounds of all threads take */
+static void yield_leader(void *arg)
+{
+	struct yield_bench *b = arg;
+	unsigned long long start;
+	uthread_attr_t attr;
+
+	uthread_attr_init(&attr);
+	attr.stack_flags = b->stack_flags;
+	for (int i = 1; i < b->threads; i++)
+		uthread_create_attr(yield_worker, b, &attr, NULL);
+
+	start = bench_now_ns();
+	for (unsigned long i = 1; i <= b->rounds; i++)
+	{
+		uthread_yield();
+		if (i % BATCH == 0)
+		{
+			unsigned long long now = bench_now_ns();
+			// Each round is one switch per worker, plus one to the idle thread
+			bench_samples_add(&samples, (double)(now - start) /
+											(BATCH * (b->threads + 1)));
+			start = now;
+		}
+	}
+}
+
+static void bench_yield(const char *name, int threads, bool preempt,
+						unsigned int stack_flags)
+{
+	struct yield_bench b = {threads, nr_ops / (threads + 1), stack_flags};
+	struct bench_result r = {.name = name,
+							 .threads = threads,
+							 .samples = &samples};
+	unsigned long long start;
+
+	if (!b.rounds)
+		b.rounds = 1;
+	bench_samples_reset(&samples);
+	start = bench_now_ns();
+	uthread_run(preempt, yield_leader, &b);
+	r.elapsed_ns = bench_now_ns() - start;
+	r.ops = b.rounds * (threads + 1);
+	bench_report(&r);
+}
+
+/*
+ * Semaphore ping-pong
+ */
+struct pingpong_bench
+{
+	sem_t ping;
+	sem_t pong;
+	unsigned long rounds;
+};
+
+static void pong(void *arg)
+{
+	struct pingpong_bench *b = arg;
+
+	for (unsigned long i = 0; i < b->rounds; i++)
+	{
+		sem_down(b->ping);
+		sem_up(b->pong);
+	}
+}
+
+static void ping(void *arg)
+{
+	struct pingpong_bench *b = arg;
+	unsigned long long start;
+
+	uthread_create(pong, b);
+
+	start = bench_now_ns();
+	for (unsigned long i = 1; i <= b->rounds; i++)
+	{
+		sem_up(b->ping);
+		sem_down(b->pong);
+		if (i % BATCH == 0)
+		{
+			unsigned long long now = bench_now_ns();
+			bench_samples_add(&samples, (double)(now - start) / BATCH);
+			start = now;
+		}
+	}
+}
+
+static void bench_sem_pingpong(void)
+{
+	struct pingpong_bench b = {sem_create(0), sem_create(0), nr_ops / 2};
+	struct bench_result r = {.name = "sem_pingpong", .threads = 2,
+							 .ops = b.rounds, .samples = &samples};
+	unsigned long long start;
+
+	bench_samples_reset(&samples);
+	start = bench_now_ns();
+	uthread_run(false, ping, &b);
+	r.elapsed_ns = bench_now_ns() - start;
+	bench_report(&r);
+
+	sem_destroy(b.ping);
+	sem_destroy(b.pong);
+}
+
+/*
+ * Generator
+ */
+static void gen_counter(void *arg)
+{
+	unsigned long rounds = *(unsigned long *)arg;
+
+	for (unsigned long i = 0; i < rounds; i++)
+		gen_yield(NULL);
+}
+
+static void gen_consumer(void *arg)
+{
+	gen_t gen = gen_create(gen_counter, arg);
+	unsigned long long start = bench_now_ns();
+	unsigned long i = 0;
+	void *value;
+
+	while (gen_next(gen, &value) == 0)
+	{
+		if (++i % BATCH == 0)
+		{
+			unsigned long long now = bench_now_ns();
+			bench_samples_add(&samples, (double)(now - start) / BATCH);
+			start = now;
+		}
+	}
+	gen_destroy(gen);
+}
+
+static void bench_gen_next(void)
+{
+	unsigned long rounds = nr_ops;
+	struct bench_result r = {.name = "gen_next", .threads = 1,
+							 .ops = rounds, .samples = &samples};
+	unsigned long long start;
+
+	bench_samples_reset(&samples);
+	start = bench_now_ns();
+	uthread_run(false, gen_consumer, &rounds);
+	r.elapsed_ns = bench_now_ns() - start;
+	bench_report(&r);
+}
+
+/*
+ * Coroutine yield
+ */
+struct coro_bench
+{
+	struct coro co;
+	int coros;
+	unsigned long i;
+	unsigned long rounds;
+	unsigned long long start;
+};
+
+/* Every coroutine yields in turn, the first one samples how long rounds take */
+static int coro_yielder(struct coro *co)
+{
+	struct coro_bench *c = (struct coro_bench *)co;
+
+	CORO_BEGIN(co);
+	c->start = bench_now_ns();
+	for (c->i = 1; c->i <= c->rounds; c->i++)
+	{
+		CORO_YIELD(co);
+		if (c->coros && c->i % BATCH == 0)
+		{
+			unsigned long long now = bench_now_ns();
+			bench_samples_add(&samples,
+							  (double)(now - c->start) / (BATCH * c->coros));
+			c->start = now;
+		}
+	}
+	CORO_END(co);
+}
+
+static void coro_spawner(void *arg)
+{
+	struct coro_bench *c = arg;
+	int coros = c[0].coros;
+
+	for (int i = 0; i < coros; i++)
+		coro_spawn(&c[i].co, coro_yielder, NULL);
+}
+
+static void bench_coro_yield(int coros)
+{
+	struct coro_bench *c = calloc(coros, sizeof(*c));
+	struct bench_result r = {.name = "coro_yield", .threads = coros,
+							 .samples = &samples};
+	unsigned long rounds = nr_ops / coros ? nr_ops / coros : 1;
+	unsigned long long start;
+
+	if (!c)
+	{
+		perror("calloc");
+		exit(1);
+	}
+	for (int i = 0; i < coros; i++)
+		c[i].rounds = rounds;
+	// Only the first one samples
+	c[0].coros = coros;
+
+	bench_samples_reset(&samples);
+	start = bench_now_ns();
+	uthread_run(false, coro_spawner, c);
+	r.elapsed_ns = bench_now_ns() - start;
+	r.ops = rounds * coros;
+	bench_report(&r);
+	free(c);
+}
+
+/*
+ * Thread creation and exit
+ */
+struct create_bench
+{
+	int threads;
+	int alive;
+	unsigned long total;
+};
+
+static void noop(void *arg)
+{
+	struct create_bench *b = arg;
+
+	b->alive--;
+}
+
+static void creator(void *arg)
+{
+	struct create_bench *b = arg;
+
+	for (unsigned long done = 0; done < b->total; done += b->threads)
+	{
+		unsigned long long start = bench_now_ns();
+
+		for (int i = 0; i < b->threads; i++)
+		{
+			if (uthread_create(noop, b) == -1)
+			{
+				fprintf(stderr, "uthread_create failed\n");
+				exit(1);
+			}
+			b->alive++;
+		}
+		while (b->alive)
+			uthread_yield();
+
+		bench_samples_add(&samples,
+						  (double)(bench_now_ns() - start) / b->threads);
+	}
+}
+
+static void bench_create_exit(int threads)
+{
+	struct create_bench b = {threads, 0, nr_ops / 4};
+	struct bench_result r = {.name = "create_exit", .threads = threads,
+							 .samples = &samples};
+	unsigned long long start;
+
+	if (b.total < (unsigned long)threads)
+		b.total = threads;
+	bench_samples_reset(&samples);
+	start = bench_now_ns();
+	uthread_run(false, creator, &b);
+	r.elapsed_ns = bench_now_ns() - start;
+	r.ops = (b.total + threads - 1) / threads * threads;
+	bench_report(&r);
+}
+
+/*
+ * Queue
+ */
+static void bench_queue(int depth)
+{
+	struct bench_result r = {.name = "queue_enq_deq", .threads = depth,
+							 .ops = nr_ops, .samples = &samples};
+	queue_t q = queue_create();
+	static int item;
+	void *data;
+	unsigned long long start, batch_start;
+
+	for (int i = 0; i < depth; i++)
+		queue_enqueue(q, &item);
+
+	bench_samples_reset(&samples);
+	start = batch_start = bench_now_ns();
+	for (unsigned long i = 1; i <= nr_ops; i++)
+	{
+		queue_enqueue(q, &item);
+		queue_dequeue(q, &data);
+		if (i % BATCH == 0)
+		{
+			unsigned long long now = bench_now_ns();
+			bench_samples_add(&samples, (double)(now - batch_start) / BATCH);
+			batch_start = now;
+		}
+	}
+	r.elapsed_ns = bench_now_ns() - start;
+	bench_report(&r);
+
+	while (queue_dequeue(q, &data) == 0)
+		;
+	queue_destroy(q);
+}
+
+static unsigned long get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX || ret <= 0)
+	{
+		fprintf(stderr, "invalid number: %s\n", argv);
+		exit(1);
+	}
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-f text|csv|json] [-n ops] [-t max_threads]\n",
+			prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int max_threads = DEFAULT_MAX_THREADS;
+	int opt, t;
+
+	while ((opt = getopt(argc, argv, "f:n:t:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f':
+			if (bench_parse_format(optarg))
+				usage(argv[0]);
+			break;
+		case 'n':
+			nr_ops = get_argv(optarg);
+			break;
+		case 't':
+			max_threads = get_argv(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	bench_report_begin();
+	for (t = 2; t <= max_threads; t *= 8)
+		bench_yield("yield", t, false, 0);
+	for (t = 2; t <= max_threads; t *= 8)
+		bench_yield("yield_preempt", t, true, 0);
+	for (t = 2; t <= max_threads; t *= 8)
+		bench_yield("yield_shared", t, false, UTHREAD_STACK_SHARED);
+	bench_sem_pingpong();
+	bench_gen_next();
+	for (t = 2; t <= max_threads; t *= 8)
+		bench_coro_yield(t);
+	for (t = 1; t <= max_threads; t *= 8)
+		bench_create_exit(t);
+	for (t = 0; t <= max_threads; t = t ? t * 8 : 1)
+		bench_queue(t);
+	bench_report_end();
+
+	free(samples.v);
+	return 0;
+}
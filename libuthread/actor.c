@@ -0,0 +1,142 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "actor.h"
+#include "private.h"
+#include "uthread.h"
+
+/*
+ * Mailboxes
+ *
+ * Senders push messages on a lock-free list, which the actor takes all at
+ * once and reverses to handle the messages in order. An actor about to park
+ * swaps its empty mailbox for ACTOR_IDLE: the sender replacing ACTOR_IDLE by
+ * its message is the one making the mailbox non-empty, and wakes the actor up.
+ * Waking up a thread of another runtime is deferred until that runtime's idle
+ * thread runs, i.e. once the actor blocked, so that a wake-up never comes too
+ * early.
+ */
+#define ACTOR_IDLE ((struct actor_msg *)1)
+
+struct actor
+{
+	/* Messages sent, newest first, or ACTOR_IDLE */
+	struct actor_msg *mailbox;
+	actor_func_t func;
+	void *arg;
+	/* Waiter of the actor's thread, woken up when it has mail */
+	struct sem_waiter *waiter;
+	/* Sent by actor_destroy(), as the last message */
+	struct actor_msg stop;
+};
+
+static void actor_loop(void *arg)
+{
+	struct actor *actor = arg;
+	uthread_runtime_t rt = uthread_runtime_hold();
+	struct actor_msg *msg, *fifo;
+	bool stopping = false;
+	int nr_handled = 0;
+
+	actor->waiter = uthread_waiter();
+	while (!stopping)
+	{
+		msg = __atomic_exchange_n(&actor->mailbox, NULL, __ATOMIC_ACQUIRE);
+		if (!msg)
+		{
+			struct actor_msg *empty = NULL;
+
+			if (uthread_rt.to_preempt)
+				preempt_disable();
+			if (__atomic_compare_exchange_n(&actor->mailbox, &empty,
+											ACTOR_IDLE, false,
+											__ATOMIC_SEQ_CST,
+											__ATOMIC_RELAXED))
+			{
+				preempt_enable();
+				// Woken up by the sender of the next message
+				uthread_block();
+				nr_handled = 0;
+			}
+			else
+				preempt_enable();
+			continue;
+		}
+
+		fifo = NULL;
+		while (msg)
+		{
+			struct actor_msg *next = msg->next;
+
+			msg->next = fifo;
+			fifo = msg;
+			msg = next;
+		}
+
+		while (fifo)
+		{
+			msg = fifo;
+			fifo = msg->next;
+			if (msg == &actor->stop)
+			{
+				stopping = true;
+				continue;
+			}
+			actor->func(msg, actor->arg);
+			if (++nr_handled == ACTOR_BATCH)
+			{
+				nr_handled = 0;
+				uthread_yield();
+			}
+		}
+	}
+
+	uthread_runtime_release(rt);
+	free(actor);
+}
+
+actor_t actor_create(actor_func_t func, void *arg)
+{
+	struct actor *actor;
+
+	if (!func || uthread_self() == -1)
+		return NULL;
+
+	actor = malloc(sizeof(*actor));
+	if (!actor)
+		return NULL;
+	actor->mailbox = NULL;
+	actor->func = func;
+	actor->arg = arg;
+	actor->waiter = NULL;
+	if (uthread_create(actor_loop, actor))
+	{
+		free(actor);
+		return NULL;
+	}
+	return actor;
+}
+
+int actor_send(actor_t actor, struct actor_msg *msg)
+{
+	struct actor_msg *head;
+
+	if (!actor || !msg)
+		return -1;
+
+	head = __atomic_load_n(&actor->mailbox, __ATOMIC_RELAXED);
+	do
+		msg->next = head == ACTOR_IDLE ? NULL : head;
+	while (!__atomic_compare_exchange_n(&actor->mailbox, &head, msg, true,
+										__ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+	if (head == ACTOR_IDLE)
+		actor->waiter->wake(actor->waiter);
+	return 0;
+}
+
+int actor_destroy(actor_t actor)
+{
+	if (!actor)
+		return -1;
+	return actor_send(actor, &actor->stop);
+}
@@ -0,0 +1,80 @@
+#ifndef _ACTOR_H
+#define _ACTOR_H
+
+/*
+ * actor_t - Actor type
+ *
+ * An actor handles the messages sent to its mailbox one at a time, in a
+ * thread of its own. Any thread of any runtime, or any kernel thread, can
+ * send messages to it (see uthread_run()). The thread only runs while the
+ * mailbox has messages: it parks once the mailbox is empty, and the sender
+ * that makes it non-empty wakes it up. An idle actor therefore costs the
+ * scheduler nothing.
+ *
+ * Once woken up, an actor handles everything in its mailbox before parking
+ * again. It only yields every ACTOR_BATCH messages, so that a busy actor pays
+ * for one context switch per batch rather than one per message.
+ *
+ * An actor keeps its runtime in uthread_run() until it is destroyed (see
+ * uthread_runtime_hold()).
+ */
+typedef struct actor *actor_t;
+
+/*
+ * struct actor_msg - Message sent to an actor
+ * @next: Used by the mailbox
+ *
+ * Messages are meant to be embedded in larger structures holding their
+ * payload. Sending does not copy or allocate anything: a message belongs to
+ * the actor from actor_send() until its handler returns.
+ */
+struct actor_msg
+{
+	struct actor_msg *next;
+};
+
+/*
+ * actor_func_t - Message handler of an actor
+ * @msg: Message to handle
+ * @arg: Argument passed to actor_create()
+ */
+typedef void (*actor_func_t)(struct actor_msg *msg, void *arg);
+
+/*
+ * ACTOR_BATCH - Number of messages an actor handles before yielding
+ */
+#define ACTOR_BATCH 64
+
+/*
+ * actor_create - Create an actor in the runtime of the calling thread
+ * @func: Function handling each message
+ * @arg: Argument to be passed to @func
+ *
+ * Return: New actor, or NULL if @func is NULL, if not called from a thread,
+ * or in case of failure when creating it
+ */
+actor_t actor_create(actor_func_t func, void *arg);
+
+/*
+ * actor_destroy - Destroy an actor
+ * @actor: Actor to destroy
+ *
+ * The messages sent to @actor before are still handled, after which its
+ * thread exits and frees it. No message may be sent to @actor afterwards.
+ *
+ * Return: -1 if @actor is NULL. 0 otherwise.
+ */
+int actor_destroy(actor_t actor);
+
+/*
+ * actor_send - Send a message to an actor
+ * @actor: Actor to send the message to
+ * @msg: Message to send
+ *
+ * Messages from a same sender are handled in the order they were sent.
+ *
+ * Return: -1 if @actor or @msg is NULL. 0 otherwise.
+ */
+int actor_send(actor_t actor, struct actor_msg *msg);
+
+#endif /* _ACTOR_H */
@@ -1,11 +1,15 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "private.h"
 #include "uthread.h"
 
-/* Size of the stack for a thread (in bytes) */
-#define UTHREAD_STACK_SIZE 32768
+/* Pattern painted on stacks whose usage is measured */
+#define STACK_PAINT 0x5354414b5354414bULL /* "STAKSTAK" */
 
 void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next)
 {
@@ -19,14 +23,97 @@ void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next)
 	}
 }
 
-void *uthread_ctx_alloc_stack(void)
+/* Round @size up to a whole number of pages */
+static size_t page_align(size_t size)
 {
-	return malloc(UTHREAD_STACK_SIZE);
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	return (size + page - 1) & ~(page - 1);
+}
+
+void *uthread_ctx_alloc_stack(size_t size, unsigned int flags)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	char *map;
+
+	if (!(flags & UTHREAD_STACK_GROWABLE))
+		return malloc(size);
+
+	/*
+	 * Reserve the stack plus a guard page below it: stacks grow down, so an
+	 * overflow hits the guard page rather than whatever is mapped below
+	 */
+	map = mmap(NULL, page + page_align(size), PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+	if (mprotect(map, page, PROT_NONE))
+	{
+		munmap(map, page + page_align(size));
+		return NULL;
+	}
+	return map + page;
+}
+
+void uthread_ctx_paint_stack(void *top_of_stack, size_t size)
+{
+	uint64_t *word = top_of_stack;
+
+	for (size_t i = 0; i < size / sizeof(*word); i++)
+		word[i] = STACK_PAINT;
+}
+
+/* Span of the resident pages of a growable stack, from its bottom */
+static size_t stack_resident(void *top_of_stack, size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t nr_pages = page_align(size) / page;
+	unsigned char *vec = malloc(nr_pages);
+	size_t i = 0;
+
+	if (!vec)
+		return 0;
+	if (mincore(top_of_stack, nr_pages * page, vec))
+	{
+		free(vec);
+		return 0;
+	}
+	while (i < nr_pages && !(vec[i] & 1))
+		i++;
+	free(vec);
+	// The last page may extend past the end of an unaligned stack
+	return (nr_pages - i) * page < size ? (nr_pages - i) * page : size;
+}
+
+size_t uthread_ctx_stack_used(void *top_of_stack, size_t size,
+							  unsigned int flags)
+{
+	uint64_t *word = top_of_stack;
+	size_t i = 0;
+
+	if (flags & UTHREAD_STACK_GROWABLE)
+		return stack_resident(top_of_stack, size);
+
+	/*
+	 * Stacks grow down, from the end of the segment: the part that was never
+	 * reached is the painted one at the beginning
+	 */
+	while (i < size / sizeof(*word) && word[i] == STACK_PAINT)
+		i++;
+	return size - i * sizeof(*word);
 }
 
-void uthread_ctx_destroy_stack(void *top_of_stack)
+void uthread_ctx_destroy_stack(void *top_of_stack, size_t size,
+							   unsigned int flags)
 {
-	free(top_of_stack);
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	if (!(flags & UTHREAD_STACK_GROWABLE))
+	{
+		free(top_of_stack);
+		return;
+	}
+	munmap((char *)top_of_stack - page, page + page_align(size));
 }
 
 /*
@@ -46,7 +133,7 @@ static void uthread_ctx_bootstrap(uthread_func_t func, void *arg)
 	uthread_exit();
 }
 
-int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
+int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack, size_t stack_size,
 		     uthread_func_t func, void *arg)
 {
 	/*
@@ -59,7 +146,7 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 	 * Change context @uctx's stack to the specified stack
 	 */
 	uctx->uc_stack.ss_sp = top_of_stack;
-	uctx->uc_stack.ss_size = UTHREAD_STACK_SIZE;
+	uctx->uc_stack.ss_size = stack_size;
 
 	/*
 	 * Finish setting up context @uctx:
@@ -74,3 +161,184 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 	return 0;
 }
 
+
+/*
+ * Shared stack
+ *
+ * Threads created with UTHREAD_STACK_SHARED all run on the same stack. The
+ * thread currently owning it keeps its frames there; the others have the live
+ * part of their stack saved in a heap buffer sized to it. Copying stacks
+ * cannot be done from the shared stack itself, so switching to a thread that
+ * does not own it goes through the switcher context, which has a stack of its
+ * own.
+ */
+
+/* Size of the stack of the switcher context (in bytes) */
+#define SWITCHER_STACK_SIZE 16384
+
+/*
+ * Bytes below the recorded stack pointer of a thread that are live too: the
+ * frames of the functions performing the switch
+ */
+#define SHARED_STACK_MARGIN 512
+
+static __thread char *shared_stack;
+static __thread uthread_ctx_t switcher_ctx;
+static __thread struct uthread_shared_ctx *shared_owner;
+static __thread struct uthread_shared_ctx *shared_next;
+static __thread uthread_ctx_t *shared_next_ctx;
+
+static int shared_stack_save(struct uthread_shared_ctx *sctx)
+{
+	char *top = shared_stack + UTHREAD_SHARED_STACK_SIZE;
+	size_t len = top - sctx->sp;
+
+	if (len > sctx->cap)
+	{
+		void *buf = realloc(sctx->buf, len);
+
+		if (!buf)
+			return -1;
+		sctx->buf = buf;
+		sctx->cap = len;
+	}
+	memcpy(sctx->buf, sctx->sp, len);
+	sctx->len = len;
+	return 0;
+}
+
+static void shared_stack_restore(struct uthread_shared_ctx *sctx)
+{
+	char *top = shared_stack + UTHREAD_SHARED_STACK_SIZE;
+
+	memcpy(top - sctx->len, sctx->buf, sctx->len);
+}
+
+/*
+ * uthread_ctx_switcher - Main loop of the switcher context
+ *
+ * Each time the switcher is switched to, hand the shared stack over to
+ * @shared_next and resume it.
+ */
+static void uthread_ctx_switcher(void)
+{
+	for (;;)
+	{
+		struct uthread_shared_ctx *next = shared_next;
+
+		if (shared_owner && shared_stack_save(shared_owner))
+		{
+			perror("shared stack");
+			exit(1);
+		}
+
+		if (next->started)
+		{
+			shared_stack_restore(next);
+		}
+		else
+		{
+			uthread_ctx_init(next->ctx, shared_stack,
+							 UTHREAD_SHARED_STACK_SIZE, next->func, next->arg);
+			next->started = true;
+		}
+		shared_owner = next;
+		uthread_ctx_switch(&switcher_ctx, shared_next_ctx);
+	}
+}
+
+static int shared_stack_init(void)
+{
+	void *switcher_stack;
+
+	if (shared_stack)
+		return 0;
+
+	shared_stack = malloc(UTHREAD_SHARED_STACK_SIZE);
+	switcher_stack = malloc(SWITCHER_STACK_SIZE);
+	if (!shared_stack || !switcher_stack || getcontext(&switcher_ctx))
+	{
+		free(shared_stack);
+		free(switcher_stack);
+		shared_stack = NULL;
+		return -1;
+	}
+	switcher_ctx.uc_stack.ss_sp = switcher_stack;
+	switcher_ctx.uc_stack.ss_size = SWITCHER_STACK_SIZE;
+	switcher_ctx.uc_link = NULL;
+	makecontext(&switcher_ctx, uthread_ctx_switcher, 0);
+	return 0;
+}
+
+int uthread_ctx_shared_init(struct uthread_shared_ctx *sctx, uthread_ctx_t *uctx,
+							uthread_func_t func, void *arg)
+{
+	if (shared_stack_init())
+		return -1;
+
+	/*
+	 * The context itself is only set up by the switcher, when the thread
+	 * first gets the shared stack: doing it now would overwrite the frames of
+	 * its current owner
+	 */
+	sctx->ctx = uctx;
+	sctx->func = func;
+	sctx->arg = arg;
+	sctx->started = false;
+	sctx->sp = NULL;
+	sctx->buf = NULL;
+	sctx->len = 0;
+	sctx->cap = 0;
+	return 0;
+}
+
+void uthread_ctx_switch_shared(uthread_ctx_t *prev,
+							   struct uthread_shared_ctx *prev_shared,
+							   uthread_ctx_t *next,
+							   struct uthread_shared_ctx *next_shared)
+{
+	if (prev_shared)
+	{
+		char *sp = (char *)__builtin_frame_address(0) - SHARED_STACK_MARGIN;
+
+		/*
+		 * Not on the shared stack (e.g. running a generator): where the
+		 * thread's frames end on the shared stack is unknown, save all of it
+		 */
+		if (sp < shared_stack || sp >= shared_stack + UTHREAD_SHARED_STACK_SIZE)
+			sp = shared_stack;
+		prev_shared->sp = sp;
+	}
+
+	if (!next_shared || next_shared == shared_owner)
+	{
+		uthread_ctx_switch(prev, next);
+		return;
+	}
+
+	shared_next = next_shared;
+	// Not necessarily next_shared->ctx, if the thread runs a generator
+	shared_next_ctx = next;
+	uthread_ctx_switch(prev, &switcher_ctx);
+}
+
+void uthread_ctx_shared_exit(struct uthread_shared_ctx *sctx)
+{
+	if (shared_owner == sctx)
+		shared_owner = NULL;
+	free(sctx->buf);
+	sctx->buf = NULL;
+	sctx->len = 0;
+	sctx->cap = 0;
+}
+
+void uthread_ctx_shared_reset(void)
+{
+	free(shared_stack);
+	free(switcher_ctx.uc_stack.ss_sp);
+	shared_stack = NULL;
+	switcher_ctx.uc_stack.ss_sp = NULL;
+	shared_owner = NULL;
+	shared_next = NULL;
+	shared_next_ctx = NULL;
+}
@@ -0,0 +1,133 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "coro.h"
+#include "private.h"
+#include "queue.h"
+#include "uthread.h"
+
+/* Coroutines ready to be resumed */
+static __thread queue_t coro_ready_q;
+/* Coroutines spawned and not finished yet */
+static __thread unsigned long nr_coros;
+/* Executor thread, created when a coroutine is spawned and none is running */
+static __thread bool executor_alive;
+static __thread struct uthread_tcb *executor;
+/* Whether the executor is blocked, waiting for a coroutine to be woken up */
+static __thread bool executor_idle;
+
+static void coro_ready(struct coro *co)
+{
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	queue_enqueue(coro_ready_q, co);
+	preempt_enable();
+
+	if (executor_idle)
+	{
+		executor_idle = false;
+		uthread_unblock(executor);
+	}
+}
+
+static void coro_wake(struct sem_waiter *waiter)
+{
+	coro_ready(waiter->data);
+}
+
+/*
+ * coro_executor - Main function of the executor thread
+ *
+ * Resume the ready coroutines in order, letting the other threads run after
+ * each batch of them, until no coroutine is left.
+ */
+static void coro_executor(void *arg)
+{
+	(void)arg;
+
+	executor = uthread_current();
+	while (nr_coros)
+	{
+		int batch = queue_length(coro_ready_q);
+		struct coro *co;
+
+		if (!batch)
+		{
+			executor_idle = true;
+			uthread_block();
+			continue;
+		}
+
+		while (batch-- && queue_dequeue(coro_ready_q, (void **)&co) == 0)
+		{
+			switch (co->func(co))
+			{
+			case CORO_YIELDED:
+				queue_enqueue(coro_ready_q, co);
+				break;
+			case CORO_WAITING:
+				break;
+			case CORO_DONE:
+				nr_coros--;
+				if (co->exit)
+					co->exit(co);
+				break;
+			}
+		}
+		uthread_yield();
+	}
+
+	executor = NULL;
+	executor_alive = false;
+}
+
+int coro_spawn(struct coro *co, coro_func_t func, void (*exit)(struct coro *co))
+{
+	if (!co || !func || uthread_self() == -1)
+		return -1;
+
+	if (!coro_ready_q)
+	{
+		coro_ready_q = queue_create();
+		if (!coro_ready_q)
+			return -1;
+	}
+	if (!executor_alive)
+	{
+		if (uthread_create(coro_executor, NULL) == -1)
+			return -1;
+		executor_alive = true;
+	}
+
+	co->line = 0;
+	co->func = func;
+	co->exit = exit;
+	co->waiter.wake = coro_wake;
+	co->waiter.data = co;
+	co->waiter.node = NULL;
+	nr_coros++;
+	coro_ready(co);
+	return 0;
+}
+
+int coro_sem_down(struct coro *co, sem_t sem)
+{
+	return sem_down_async(sem, &co->waiter);
+}
+
+void coro_runtime_reset(void)
+{
+	void *co;
+
+	if (coro_ready_q)
+	{
+		while (queue_dequeue(coro_ready_q, &co) == 0)
+			;
+		queue_destroy(coro_ready_q);
+		coro_ready_q = NULL;
+	}
+	nr_coros = 0;
+	executor_alive = false;
+	executor = NULL;
+	executor_idle = false;
+}
@@ -0,0 +1,177 @@
+#ifndef _CORO_H
+#define _CORO_H
+
+#include "sem.h"
+
+/*
+ * Stackless coroutines
+ *
+ * A coroutine is a function that can suspend itself and be resumed later where
+ * it left off, without a stack of its own: when suspended it simply returns,
+ * and when resumed it is called again and jumps back to the point where it
+ * suspended (protothread-style, with a switch statement). All the coroutines
+ * are run, one after the other, by an executor thread created on demand and
+ * scheduled like any other thread.
+ *
+ * A coroutine is thus only as large as the structure it keeps its state in,
+ * which embeds a struct coro as its first member. Local variables of the
+ * coroutine function do NOT survive suspension points, and a suspension point
+ * cannot be inside a switch statement of the coroutine function. Coroutines
+ * must not call functions blocking or yielding the thread they run on, such as
+ * sem_down() or uthread_yield(), which would stall all the other coroutines:
+ * they wait with the CORO_* macros instead.
+ *
+ * Example:
+ *
+ *	struct counter {
+ *		struct coro co;
+ *		sem_t sem;
+ *		int count;
+ *	};
+ *
+ *	static int count(struct coro *co)
+ *	{
+ *		struct counter *c = (struct counter *)co;
+ *
+ *		CORO_BEGIN(co);
+ *		while (c->count < 10) {
+ *			CORO_SEM_DOWN(co, c->sem);
+ *			c->count++;
+ *		}
+ *		CORO_END(co);
+ *	}
+ */
+
+struct coro;
+
+/*
+ * coro_func_t - Coroutine function type
+ * @co: Coroutine being run
+ *
+ * Return: One of the CORO_* statuses, as returned by the coroutine macros.
+ */
+typedef int (*coro_func_t)(struct coro *co);
+
+/*
+ * Statuses returned by coroutine functions
+ * @CORO_YIELDED: The coroutine is to be resumed once the other ready
+ *	coroutines and threads had a chance to run
+ * @CORO_WAITING: The coroutine is to be resumed once what it waits for happens
+ * @CORO_DONE: The coroutine finished
+ */
+enum
+{
+	CORO_YIELDED,
+	CORO_WAITING,
+	CORO_DONE,
+};
+
+/*
+ * struct coro - Coroutine
+ * @line: Point where to resume the coroutine, 0 to start it
+ * @func: Coroutine function
+ * @exit: Function called once the coroutine finished, e.g. to free it, or NULL
+ * @waiter: Waiter used to wait on semaphores
+ *
+ * The fields are private to the library and to the coroutine macros.
+ */
+struct coro
+{
+	int line;
+	coro_func_t func;
+	void (*exit)(struct coro *co);
+	struct sem_waiter waiter;
+};
+
+/*
+ * coro_spawn - Start a coroutine
+ * @co: Coroutine to start
+ * @func: Coroutine function
+ * @exit: Function called once the coroutine finished, or NULL
+ *
+ * Make coroutine @co ready to run @func from its beginning, creating the
+ * executor thread if there is none. Can only be called from a thread. @co
+ * must stay valid until @exit is called, or until the end of uthread_run() for
+ * coroutines that never finish.
+ *
+ * Return: -1 if @co or @func is NULL, if not called from a thread, or in case
+ * of failure when creating the executor thread. 0 otherwise.
+ */
+int coro_spawn(struct coro *co, coro_func_t func, void (*exit)(struct coro *co));
+
+/*
+ * coro_sem_down - Take a semaphore from a coroutine
+ * @co: Coroutine taking the semaphore
+ * @sem: Semaphore to take
+ *
+ * Use CORO_SEM_DOWN() rather than this function directly.
+ *
+ * Return: -1 if @sem is NULL. 0 if semaphore was successfully taken, 1 if
+ * @co is to be resumed once the semaphore is handed over to it.
+ */
+int coro_sem_down(struct coro *co, sem_t sem);
+
+/* Resuming jumps into the middle of the macros, falling through is intended */
+#define CORO_FALLTHROUGH __attribute__((fallthrough))
+
+/*
+ * CORO_BEGIN - Start the body of a coroutine function
+ * @co: Coroutine
+ */
+#define CORO_BEGIN(co)     \
+	switch ((co)->line)    \
+	{                      \
+	case 0:
+
+/*
+ * CORO_END - End the body of a coroutine function, finishing the coroutine
+ * @co: Coroutine
+ */
+#define CORO_END(co)       \
+	}                      \
+	(co)->line = 0;        \
+	return CORO_DONE
+
+/*
+ * CORO_YIELD - Let other coroutines and threads run
+ * @co: Coroutine
+ */
+#define CORO_YIELD(co)             \
+	do                             \
+	{                              \
+		(co)->line = __LINE__;     \
+		return CORO_YIELDED;       \
+	case __LINE__:;                \
+	} while (0)
+
+/*
+ * CORO_WAIT_UNTIL - Yield until a condition is true
+ * @co: Coroutine
+ * @cond: Condition, evaluated each time the coroutine is resumed
+ */
+#define CORO_WAIT_UNTIL(co, cond)  \
+	do                             \
+	{                              \
+		(co)->line = __LINE__;     \
+		CORO_FALLTHROUGH;          \
+	case __LINE__:                 \
+		if (!(cond))               \
+			return CORO_YIELDED;   \
+	} while (0)
+
+/*
+ * CORO_SEM_DOWN - Take a semaphore, waiting for it if unavailable
+ * @co: Coroutine
+ * @sem: Semaphore to take
+ */
+#define CORO_SEM_DOWN(co, sem)                 \
+	do                                         \
+	{                                          \
+		(co)->line = __LINE__;                 \
+		if (coro_sem_down((co), (sem)) == 1)   \
+			return CORO_WAITING;               \
+		CORO_FALLTHROUGH;                      \
+	case __LINE__:;                            \
+	} while (0)
+
+#endif /* _CORO_H */
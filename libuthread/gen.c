@@ -0,0 +1,145 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "gen.h"
+#include "private.h"
+#include "uthread.h"
+
+struct generator
+{
+	/* Context of the generator while suspended */
+	uthread_ctx_t ctx;
+	/* Context of the consumer while the generator runs */
+	uthread_ctx_t caller;
+	/* Context of the consumer's thread, restored when the generator yields */
+	uthread_ctx_t *thread_ctx;
+	/* Generator the consumer itself is running, if any */
+	struct generator *parent;
+	void *stack;
+	uthread_func_t func;
+	void *arg;
+	void *value;
+	bool running;
+	bool done;
+};
+
+/* Generator running outside of any thread, i.e. outside of uthread_run() */
+static __thread struct generator *orphan_gen;
+
+static struct generator *gen_current(void)
+{
+	return uthread_self() == -1 ? orphan_gen : uthread_generator();
+}
+
+static void gen_set_current(struct generator *gen)
+{
+	if (uthread_self() == -1)
+		orphan_gen = gen;
+	else
+		uthread_set_generator(gen);
+}
+
+/*
+ * gen_switch_back - Return control from the running generator to its consumer
+ * @gen: Running generator
+ */
+static void gen_switch_back(struct generator *gen)
+{
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	gen->running = false;
+	gen_set_current(gen->parent);
+	uthread_ctx_borrow(gen->thread_ctx);
+	uthread_ctx_switch(&gen->ctx, &gen->caller);
+	preempt_enable();
+}
+
+static void gen_bootstrap(void *arg)
+{
+	struct generator *gen = arg;
+
+	gen->func(gen->arg);
+	gen->done = true;
+	gen_switch_back(gen);
+	// Never resumed once done
+}
+
+gen_t gen_create(uthread_func_t func, void *arg)
+{
+	struct generator *gen;
+
+	if (!func)
+		return NULL;
+
+	gen = malloc(sizeof(*gen));
+	if (!gen)
+		return NULL;
+	gen->stack = uthread_ctx_alloc_stack(UTHREAD_STACK_SIZE, 0);
+	if (!gen->stack)
+	{
+		free(gen);
+		return NULL;
+	}
+	if (uthread_ctx_init(&gen->ctx, gen->stack, UTHREAD_STACK_SIZE,
+						 gen_bootstrap, gen) == -1)
+	{
+		uthread_ctx_destroy_stack(gen->stack, UTHREAD_STACK_SIZE, 0);
+		free(gen);
+		return NULL;
+	}
+
+	gen->func = func;
+	gen->arg = arg;
+	gen->running = false;
+	gen->done = false;
+	return gen;
+}
+
+int gen_destroy(gen_t gen)
+{
+	if (!gen || gen->running)
+		return -1;
+
+	uthread_ctx_destroy_stack(gen->stack, UTHREAD_STACK_SIZE, 0);
+	free(gen);
+	return 0;
+}
+
+int gen_next(gen_t gen, void **value)
+{
+	if (!gen || !value || gen->running)
+		return -1;
+	if (gen->done)
+		return 1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	gen->running = true;
+	gen->parent = gen_current();
+	gen_set_current(gen);
+	/*
+	 * The thread goes on running the generator: should it be switched out,
+	 * that is the context to save and to resume later
+	 */
+	gen->thread_ctx = uthread_ctx_borrow(&gen->ctx);
+	uthread_ctx_switch(&gen->caller, &gen->ctx);
+	preempt_enable();
+
+	if (gen->done)
+		return 1;
+	*value = gen->value;
+	uthread_consume_budget();
+	return 0;
+}
+
+int gen_yield(void *value)
+{
+	struct generator *gen = gen_current();
+
+	if (!gen)
+		return -1;
+
+	gen->value = value;
+	gen_switch_back(gen);
+	return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef _GEN_H
+#define _GEN_H
+
+#include "uthread.h"
+
+/*
+ * gen_t - Generator type
+ *
+ * A generator runs a function on a stack of its own, producing values one at a
+ * time for its consumer: each call to gen_next() from the consumer runs the
+ * generator until it yields a value with gen_yield(), at which point the
+ * consumer resumes with that value. Control goes directly from one to the
+ * other, without going through the scheduler.
+ *
+ * The generator runs on behalf of the thread calling gen_next(): if it blocks,
+ * e.g. on a semaphore, that thread is blocked. Generators can consume other
+ * generators, and can be used outside of uthread_run() as long as they do not
+ * block.
+ */
+typedef struct generator *gen_t;
+
+/*
+ * gen_create - Create a generator
+ * @func: Function producing the values, with gen_yield()
+ * @arg: Argument to be passed to @func
+ *
+ * The generator starts running @func at the first call to gen_next().
+ *
+ * Return: New generator, or NULL in case of failure when allocating it.
+ */
+gen_t gen_create(uthread_func_t func, void *arg);
+
+/*
+ * gen_destroy - Deallocate a generator
+ * @gen: Generator to deallocate
+ *
+ * A generator that did not finish is abandoned where it last yielded: its
+ * function is not resumed, and whatever it allocated is leaked.
+ *
+ * Return: -1 if @gen is NULL or currently running. 0 otherwise.
+ */
+int gen_destroy(gen_t gen);
+
+/*
+ * gen_next - Get the next value of a generator
+ * @gen: Generator to run
+ * @value: Address where to store the value
+ *
+ * Run generator @gen until it yields a value or its function returns. Each
+ * value produced spends a unit of the yield budget of the calling thread (see
+ * uthread_consume_budget()).
+ *
+ * Return: -1 if @gen or @value is NULL, or if @gen is currently running. 1 if
+ * the function of @gen returned, in which case @value is left untouched. 0
+ * otherwise.
+ */
+int gen_next(gen_t gen, void **value);
+
+/*
+ * gen_yield - Produce a value from a generator
+ * @value: Value to give to the consumer
+ *
+ * Switch back to the consumer of the running generator, which gets @value from
+ * gen_next(). Return when the consumer asks for the next value.
+ *
+ * Return: -1 if not called from a generator. 0 otherwise.
+ */
+int gen_yield(void *value);
+
+#endif /* _GEN_H */
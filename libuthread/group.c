@@ -0,0 +1,187 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "group.h"
+#include "private.h"
+#include "queue.h"
+#include "uthread.h"
+
+struct group_child
+{
+	struct group *group;
+	group_func_t func;
+	void *arg;
+	struct uthread_tcb *tcb;
+	/* Node in the running children of the group */
+	queue_handle_t node;
+	/* Next exited child, waiting to be freed */
+	struct group_child *next;
+};
+
+struct group
+{
+	/* Children still running */
+	queue_t children;
+	/* Children exited, freed by group_wait() or group_destroy() */
+	struct group_child *exited;
+	/* Thread blocked in group_wait() */
+	struct uthread_tcb *waiter;
+	/* Status of the first child that failed */
+	int status;
+	bool cancelled;
+};
+
+static void group_cancel_child(queue_t queue, void *data)
+{
+	struct group_child *child = data;
+	(void)queue;
+
+	uthread_cancel_tcb(child->tcb);
+}
+
+void group_cancel_children(struct group *group)
+{
+	group->cancelled = true;
+	queue_iterate(group->children, group_cancel_child);
+}
+
+/* Free the exited children of @group, all of which were switched out of */
+static void group_reap(struct group *group)
+{
+	struct group_child *child;
+
+	while ((child = group->exited))
+	{
+		group->exited = child->next;
+		uthread_reap(child->tcb);
+		free(child);
+	}
+}
+
+static void group_bootstrap(void *arg)
+{
+	struct group_child *child = arg;
+	struct group *group = child->group;
+	int status = child->func(child->arg);
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	queue_remove_handle(group->children, child->node);
+	// Freed by the waiter, which only runs once this thread is switched out
+	child->next = group->exited;
+	group->exited = child;
+	if (status && !group->status)
+	{
+		group->status = status;
+		group_cancel_children(group);
+	}
+	if (!queue_length(group->children) && group->waiter)
+	{
+		uthread_unblock(group->waiter);
+		group->waiter = NULL;
+	}
+	preempt_enable();
+}
+
+group_t group_create(void)
+{
+	struct group *group = malloc(sizeof(*group));
+
+	if (!group)
+		return NULL;
+	group->children = queue_create();
+	if (!group->children)
+	{
+		free(group);
+		return NULL;
+	}
+	group->exited = NULL;
+	group->waiter = NULL;
+	group->status = 0;
+	group->cancelled = false;
+	return group;
+}
+
+int group_destroy(group_t group)
+{
+	if (!group || queue_length(group->children))
+		return -1;
+
+	group_reap(group);
+	queue_destroy(group->children);
+	free(group);
+	return 0;
+}
+
+int group_spawn(group_t group, group_func_t func, void *arg)
+{
+	struct group_child *child;
+
+	if (!group || !func || uthread_self() == -1)
+		return -1;
+
+	child = malloc(sizeof(*child));
+	if (!child)
+		return -1;
+	child->group = group;
+	child->func = func;
+	child->arg = arg;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	if (queue_enqueue_handle(group->children, child, &child->node) == -1)
+	{
+		preempt_enable();
+		free(child);
+		return -1;
+	}
+	child->tcb = uthread_spawn(group_bootstrap, child);
+	if (!child->tcb)
+	{
+		queue_remove_handle(group->children, child->node);
+		preempt_enable();
+		free(child);
+		return -1;
+	}
+	if (group->cancelled)
+		uthread_cancel_tcb(child->tcb);
+	preempt_enable();
+	return 0;
+}
+
+int group_wait(group_t group, int *status)
+{
+	if (!group || !status || uthread_self() == -1 || group->waiter)
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	if (queue_length(group->children))
+	{
+		group->waiter = uthread_current();
+		preempt_enable();
+		// Unblocked by the last child to exit
+		uthread_block_group(group);
+		if (uthread_rt.to_preempt)
+			preempt_disable();
+	}
+
+	*status = group->status;
+	group->status = 0;
+	group->cancelled = false;
+	group_reap(group);
+	preempt_enable();
+	return 0;
+}
+
+int group_cancel(group_t group)
+{
+	if (!group)
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	group_cancel_children(group);
+	preempt_enable();
+	return 0;
+}
@@ -0,0 +1,93 @@
+#ifndef _GROUP_H
+#define _GROUP_H
+
+#include "uthread.h"
+
+/*
+ * group_t - Task group type
+ *
+ * A task group scopes the threads spawned into it, its children, to the thread
+ * waiting for them: children are spawned with group_spawn(), and group_wait()
+ * returns once all of them exited, with the status of the first one that
+ * failed. A failing child cancels its siblings (see uthread_cancel()), so that
+ * the wait does not last longer than needed once its outcome is known.
+ *
+ * Children are not freed when they exit, but all at once when they are waited
+ * for, which keeps exiting cheap and leaves no thread behind the group.
+ *
+ * A group belongs to the runtime it was created in (see uthread_run()), and
+ * only the threads of that runtime may use it.
+ */
+typedef struct group *group_t;
+
+/*
+ * group_func_t - Function run by a child of a task group
+ * @arg: Argument passed to group_spawn()
+ *
+ * Return: 0 if the child succeeded, any other value as its failure status
+ */
+typedef int (*group_func_t)(void *arg);
+
+/*
+ * group_create - Create a task group
+ *
+ * Return: New group, or NULL in case of failure when allocating it
+ */
+group_t group_create(void);
+
+/*
+ * group_destroy - Deallocate a task group
+ * @group: Group to deallocate
+ *
+ * Children that exited but were not waited for are freed along with @group.
+ *
+ * Return: -1 if @group is NULL or if some of its children are still running. 0
+ * otherwise.
+ */
+int group_destroy(group_t group);
+
+/*
+ * group_spawn - Create a child thread in a task group
+ * @group: Group to spawn the child into
+ * @func: Function to be executed by the child
+ * @arg: Argument to be passed to @func
+ *
+ * A child spawned into a group that is cancelled, because a sibling failed or
+ * because of group_cancel(), starts cancelled.
+ *
+ * Return: -1 if @group or @func is NULL, if not called from a thread, or in
+ * case of failure when creating the child. 0 otherwise.
+ */
+int group_spawn(group_t group, group_func_t func, void *arg);
+
+/*
+ * group_wait - Wait for all the children of a task group
+ * @group: Group to wait for
+ * @status: Address where to store the status of the first child that failed,
+ *	or 0 if none did
+ *
+ * Block until all children of @group exited, including those spawned in the
+ * meantime, then free them. A cancelled caller cancels @group before waiting,
+ * as its children would otherwise outlive what they were spawned for.
+ *
+ * Once waited for, @group starts over: it is not cancelled anymore and has no
+ * failure recorded, so it can be used for another round of children.
+ *
+ * Return: -1 if @group or @status is NULL, if not called from a thread, or if
+ * another thread already waits for @group. 0 otherwise.
+ */
+int group_wait(group_t group, int *status);
+
+/*
+ * group_cancel - Cancel a task group
+ * @group: Group to cancel
+ *
+ * Cancel all the children of @group, as well as those spawned into it until
+ * it is waited for. Cancellation is not a failure: children that cope with it
+ * by returning 0 leave no status for group_wait().
+ *
+ * Return: -1 if @group is NULL. 0 otherwise.
+ */
+int group_cancel(group_t group);
+
+#endif /* _GROUP_H */
@@ -0,0 +1,70 @@
+#include <string.h>
+
+#include "hist.h"
+
+void hist_reset(struct hist *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+/*
+ * Values below 2 * HIST_SUB_BUCKETS get one bucket each. Above, a value whose
+ * most significant bit is bit e lands in sub-bucket (value >> (e - SUB_BITS))
+ * of the group of its power of two.
+ */
+static int hist_bucket(uint64_t value)
+{
+	if (value < 2 * HIST_SUB_BUCKETS)
+		return value;
+
+	int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+	int sub = (value >> shift) - HIST_SUB_BUCKETS;
+	return (shift + 1) * HIST_SUB_BUCKETS + sub;
+}
+
+/* Highest value counted in bucket @i */
+static uint64_t hist_bucket_value(int i)
+{
+	if (i < 2 * HIST_SUB_BUCKETS)
+		return i;
+
+	int shift = i / HIST_SUB_BUCKETS - 1;
+	uint64_t low = (uint64_t)(i % HIST_SUB_BUCKETS + HIST_SUB_BUCKETS) << shift;
+	return low + (1ULL << shift) - 1;
+}
+
+void hist_record(struct hist *h, uint64_t value)
+{
+	if (!h->count || value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+	h->count++;
+	h->sum += value;
+	h->buckets[hist_bucket(value)]++;
+}
+
+uint64_t hist_percentile(const struct hist *h, double percentile)
+{
+	if (!h->count)
+		return 0;
+	if (percentile >= 100)
+		return h->max;
+
+	uint64_t target = percentile / 100 * h->count + 0.5;
+	uint64_t seen = 0;
+	if (target == 0)
+		target = 1;
+
+	for (int i = 0; i < HIST_NR_BUCKETS; i++)
+	{
+		seen += h->buckets[i];
+		if (seen >= target)
+		{
+			uint64_t value = hist_bucket_value(i);
+			// Never report beyond what was actually recorded
+			return value > h->max ? h->max : value;
+		}
+	}
+	return h->max;
+}
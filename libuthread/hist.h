@@ -0,0 +1,54 @@
+#ifndef _HIST_H
+#define _HIST_H
+
+#include <stdint.h>
+
+/*
+ * struct hist - Log-linear histogram of durations
+ *
+ * Values are counted in buckets whose width doubles every power of two, each
+ * power of two being split in HIST_SUB_BUCKETS linear sub-buckets (as HDR
+ * histograms do). Recording is O(1) and needs no allocation, and any value is
+ * known within 1/HIST_SUB_BUCKETS (about 6%) of its real value, from 1ns to
+ * centuries.
+ *
+ * This header is only meant to be included by files from the libuthread.
+ */
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_NR_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+struct hist
+{
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[HIST_NR_BUCKETS];
+};
+
+/*
+ * hist_reset - Forget all the recorded values
+ * @h: Histogram to reset
+ */
+void hist_reset(struct hist *h);
+
+/*
+ * hist_record - Record a value
+ * @h: Histogram in which to record @value
+ * @value: Value to record
+ */
+void hist_record(struct hist *h, uint64_t value);
+
+/*
+ * hist_percentile - Get the value at a given percentile
+ * @h: Histogram to query
+ * @percentile: Percentile, between 0 and 100
+ *
+ * Return: The smallest recorded value (to the precision of its bucket) such
+ * that @percentile percent of the recorded values are less or equal to it. 0
+ * if nothing was recorded.
+ */
+uint64_t hist_percentile(const struct hist *h, double percentile);
+
+#endif /* _HIST_H */
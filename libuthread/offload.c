@@ -0,0 +1,172 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/*
+ * Offloading
+ *
+ * Green threads submit jobs to a queue protected by a mutex, served by a pool
+ * of kernel threads shared by all the runtimes. Completed jobs are pushed on a
+ * lock-free list of the runtime that submitted them, which gets rung so that
+ * its idle thread can sleep until one completes when no green thread is ready.
+ * Completions are collected by the idle thread, which unblocks the green
+ * threads that submitted them.
+ */
+
+struct offload_job
+{
+	void *(*func)(void *);
+	void *arg;
+	void *result;
+	struct uthread_tcb *tcb;
+	struct uthread_runtime *rt;
+	struct offload_job *next;
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+/* Submitted jobs not picked by a worker yet, protected by pool_lock */
+static struct offload_job *submit_head, *submit_tail;
+static int nr_workers, nr_idle_workers;
+
+static void *offload_worker(void *arg)
+{
+	sigset_t set;
+	(void)arg;
+
+	// Preemption is for green threads only
+	sigemptyset(&set);
+	sigaddset(&set, SIGVTALRM);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	pthread_mutex_lock(&pool_lock);
+	for (;;)
+	{
+		struct offload_job *job = submit_head;
+		struct uthread_runtime *rt;
+
+		if (!job)
+		{
+			nr_idle_workers++;
+			pthread_cond_wait(&pool_cond, &pool_lock);
+			nr_idle_workers--;
+			continue;
+		}
+		submit_head = job->next;
+		if (!submit_head)
+			submit_tail = NULL;
+		pthread_mutex_unlock(&pool_lock);
+
+		job->result = job->func(job->arg);
+
+		// The job may be freed as soon as it is on the list
+		rt = job->rt;
+		runtime_pin(rt);
+		job->next = __atomic_load_n(&rt->offload_done, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&rt->offload_done, &job->next, job,
+											true, __ATOMIC_SEQ_CST,
+											__ATOMIC_RELAXED))
+			;
+		runtime_ring(rt);
+		runtime_unpin(rt);
+
+		pthread_mutex_lock(&pool_lock);
+	}
+	return NULL;
+}
+
+/* Queue @job, growing the pool if all the workers are busy */
+static int offload_submit(struct offload_job *job)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&pool_lock);
+	if (!nr_idle_workers && nr_workers < UTHREAD_OFFLOAD_THREADS)
+	{
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, offload_worker, NULL) == 0)
+		{
+			pthread_detach(thread);
+			nr_workers++;
+		}
+		else if (!nr_workers)
+			ret = -1;
+	}
+	if (!ret)
+	{
+		job->next = NULL;
+		if (submit_tail)
+			submit_tail->next = job;
+		else
+			submit_head = job;
+		submit_tail = job;
+		pthread_cond_signal(&pool_cond);
+	}
+	pthread_mutex_unlock(&pool_lock);
+	return ret;
+}
+
+int uthread_offload(void *(*func)(void *), void *arg, void **result)
+{
+	struct offload_job *job;
+
+	if (!func || uthread_self() == -1 || uthread_cancel_pending())
+		return -1;
+
+	job = malloc(sizeof(*job));
+	if (!job)
+		return -1;
+	job->func = func;
+	job->arg = arg;
+	job->tcb = uthread_current();
+	job->rt = &uthread_rt;
+	if (offload_submit(job))
+	{
+		free(job);
+		return -1;
+	}
+	uthread_rt.nr_offloads++;
+
+	// Unblocked by offload_poll(), from the idle thread
+	uthread_block();
+
+	if (result)
+		*result = job->result;
+	free(job);
+	return 0;
+}
+
+int offload_poll(void)
+{
+	struct offload_job *job, *fifo = NULL;
+	int nr_woken = 0;
+
+	if (!__atomic_load_n(&uthread_rt.offload_done, __ATOMIC_RELAXED))
+		return 0;
+
+	job = __atomic_exchange_n(&uthread_rt.offload_done, NULL, __ATOMIC_ACQUIRE);
+	while (job)
+	{
+		struct offload_job *next = job->next;
+
+		job->next = fifo;
+		fifo = job;
+		job = next;
+	}
+
+	for (job = fifo; job;)
+	{
+		// The job is freed by its thread, once it runs
+		struct offload_job *next = job->next;
+
+		uthread_rt.nr_offloads--;
+		uthread_unblock(job->tcb);
+		nr_woken++;
+		job = next;
+	}
+	return nr_woken;
+}
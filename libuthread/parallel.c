@@ -0,0 +1,325 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parallel.h"
+#include "private.h"
+#include "uthread.h"
+
+/* Size of a cache line, which participants are kept from sharing */
+#define PARALLEL_LINE 64
+
+/* Chunks per participant, when picking the grain */
+#define PARALLEL_CHUNKS 8
+
+/*
+ * States of the caller of a job, once it ran out of work: the helper running
+ * over the last indices only wakes it up if it parked first
+ */
+#define PARALLEL_RUNNING 0
+#define PARALLEL_PARKED 1
+#define PARALLEL_DONE 2
+
+struct parallel_slot
+{
+	/* Part of the range left to the participant, stolen from its end */
+	long begin;
+	long end;
+	int lock;
+	/* NUMA node of the participant, -1 if its runtime is not pinned */
+	int node;
+} __attribute__((aligned(PARALLEL_LINE)));
+
+struct parallel_job
+{
+	long grain;
+	parallel_func_t func;
+	parallel_acc_func_t acc_func;
+	void *arg;
+	/* Accumulators of the participants, right after the slots */
+	char *accs;
+	size_t acc_stride;
+	int nr_slots;
+	/* Slots handed out so far, possibly more than there are */
+	int nr_joined;
+	/* Number of indices not run over yet */
+	long pending;
+	/* Caller, woken up by the helper running over the last indices */
+	struct sem_waiter *waiter;
+	/* PARALLEL_RUNNING, then parked by the caller or done by that helper */
+	int state;
+	/* Held by the caller and each helper, the last one frees the job */
+	int refs;
+	/* One per participant, the caller's first */
+	struct parallel_slot slots[];
+};
+
+static void slot_lock(struct parallel_slot *slot)
+{
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	while (__atomic_exchange_n(&slot->lock, 1, __ATOMIC_ACQUIRE))
+	{
+		while (__atomic_load_n(&slot->lock, __ATOMIC_RELAXED))
+			cpu_relax();
+	}
+}
+
+static void slot_unlock(struct parallel_slot *slot)
+{
+	__atomic_store_n(&slot->lock, 0, __ATOMIC_RELEASE);
+	preempt_enable();
+}
+
+/* Take the next chunk of the range of slot @self, if any is left */
+static bool parallel_take(struct parallel_job *job, int self, long *begin,
+						  long *end)
+{
+	struct parallel_slot *slot = &job->slots[self];
+	bool taken = false;
+
+	slot_lock(slot);
+	if (slot->begin < slot->end)
+	{
+		*begin = slot->begin;
+		*end = slot->end - slot->begin > job->grain ?
+				   slot->begin + job->grain : slot->end;
+		slot->begin = *end;
+		taken = true;
+	}
+	slot_unlock(slot);
+	return taken;
+}
+
+/*
+ * parallel_steal - Steal work for an idle participant
+ * @job: Job of the participant
+ * @self: Slot of the participant, whose range is empty
+ *
+ * Take the upper half of the range of another participant, on the same NUMA
+ * node first. A range of a chunk or less is left to its participant.
+ *
+ * Return: true if the range of @self was refilled, false if nothing is left to
+ * steal
+ */
+static bool parallel_steal(struct parallel_job *job, int self)
+{
+	int nr = __atomic_load_n(&job->nr_joined, __ATOMIC_ACQUIRE);
+	struct parallel_slot *mine = &job->slots[self];
+	int node = mine->node;
+
+	if (nr > job->nr_slots)
+		nr = job->nr_slots;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int i = 1; i < nr; i++)
+		{
+			struct parallel_slot *victim = &job->slots[(self + i) % nr];
+			long begin, end;
+
+			slot_lock(victim);
+			// Local participants on the first pass, remote ones on the second
+			if ((victim->node == node) != (pass == 0) ||
+				victim->end - victim->begin <= job->grain)
+			{
+				slot_unlock(victim);
+				continue;
+			}
+			end = victim->end;
+			begin = victim->begin + (end - victim->begin) / 2;
+			victim->end = begin;
+			slot_unlock(victim);
+
+			slot_lock(mine);
+			mine->begin = begin;
+			mine->end = end;
+			slot_unlock(mine);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * parallel_work - Run over chunks until none is left
+ * @job: Job of the participant
+ * @self: Slot of the participant
+ *
+ * Run over the chunks of slot @self, then over stolen ones. A helper running
+ * over the last indices of the job wakes the caller up, if it parked.
+ *
+ * Return: true if the participant ran over the last indices of the job, false
+ * otherwise
+ */
+static bool parallel_work(struct parallel_job *job, int self)
+{
+	void *acc = job->accs + self * job->acc_stride;
+	bool last = false;
+	long begin, end;
+
+	for (;;)
+	{
+		if (!parallel_take(job, self, &begin, &end))
+		{
+			if (!parallel_steal(job, self))
+				break;
+			continue;
+		}
+		if (job->acc_func)
+			job->acc_func(begin, end, acc, job->arg);
+		else
+			job->func(begin, end, job->arg);
+		last = !__atomic_sub_fetch(&job->pending, end - begin, __ATOMIC_ACQ_REL);
+		if (last && self &&
+			__atomic_exchange_n(&job->state, PARALLEL_DONE, __ATOMIC_ACQ_REL) ==
+				PARALLEL_PARKED)
+			job->waiter->wake(job->waiter);
+		uthread_consume_budget();
+	}
+	return last;
+}
+
+static void parallel_put(struct parallel_job *job)
+{
+	if (!__atomic_sub_fetch(&job->refs, 1, __ATOMIC_ACQ_REL))
+		free(job);
+}
+
+static void parallel_helper(void *arg)
+{
+	struct parallel_job *job = arg;
+	int self = __atomic_fetch_add(&job->nr_joined, 1, __ATOMIC_ACQ_REL);
+
+	// Runtimes started since the job was set up find no slot left
+	if (self < job->nr_slots)
+	{
+		struct parallel_slot *slot = &job->slots[self];
+
+		slot_lock(slot);
+		slot->node = uthread_runtime_node(uthread_runtime_self());
+		slot_unlock(slot);
+		parallel_work(job, self);
+	}
+	parallel_put(job);
+}
+
+/* Set a job up for @nr_slots participants, with accumulators of @size bytes */
+static struct parallel_job *parallel_job_create(int nr_slots, size_t size,
+												const void *identity)
+{
+	struct parallel_job *job;
+	size_t stride = (size + PARALLEL_LINE - 1) & ~(size_t)(PARALLEL_LINE - 1);
+	size_t header = sizeof(*job) + nr_slots * sizeof(job->slots[0]);
+	size_t total = header + nr_slots * stride;
+
+	job = aligned_alloc(PARALLEL_LINE, total);
+	if (!job)
+		return NULL;
+	memset(job, 0, header);
+	job->accs = (char *)job + header;
+	job->acc_stride = stride;
+	job->nr_slots = nr_slots;
+	for (int i = 0; i < nr_slots; i++)
+	{
+		job->slots[i].node = -1;
+		if (size)
+			memcpy(job->accs + i * stride, identity, size);
+	}
+	return job;
+}
+
+static int parallel_run(long begin, long end, long grain, parallel_func_t func,
+						parallel_acc_func_t acc_func, parallel_join_func_t join,
+						void *result, size_t size, void *arg)
+{
+	struct uthread_runtime **rts;
+	struct parallel_job *job;
+	int nr_rts, max;
+
+	if (grain < 0 || uthread_self() == -1)
+		return -1;
+	if (begin >= end)
+		return 0;
+
+	max = uthread_nr_runtimes();
+	rts = malloc(max * sizeof(*rts));
+	if (!rts)
+		return -1;
+	nr_rts = runtime_pin_others(rts, max);
+	job = parallel_job_create(nr_rts + 1, size, result);
+	if (!job)
+	{
+		for (int i = 0; i < nr_rts; i++)
+			runtime_unpin(rts[i]);
+		free(rts);
+		return -1;
+	}
+
+	if (!grain)
+		grain = (end - begin) / (PARALLEL_CHUNKS * (nr_rts + 1));
+	job->grain = grain ? grain : 1;
+	job->func = func;
+	job->acc_func = acc_func;
+	job->arg = arg;
+	job->pending = end - begin;
+	job->waiter = uthread_waiter();
+	job->refs = 1;
+	job->nr_joined = 1;
+	job->slots[0].begin = begin;
+	job->slots[0].end = end;
+	job->slots[0].node = uthread_runtime_node(uthread_runtime_self());
+
+	for (int i = 0; i < nr_rts; i++)
+	{
+		__atomic_add_fetch(&job->refs, 1, __ATOMIC_RELAXED);
+		if (uthread_send(rts[i], parallel_helper, job))
+			__atomic_sub_fetch(&job->refs, 1, __ATOMIC_RELAXED);
+		runtime_unpin(rts[i]);
+	}
+	free(rts);
+
+	if (!parallel_work(job, 0))
+	{
+		int running = PARALLEL_RUNNING;
+		// Another runtime wakes this thread up, this one must not end meanwhile
+		uthread_runtime_t rt = uthread_runtime_hold();
+
+		/*
+		 * Nothing left to steal, helpers are finishing their last chunks.
+		 * Their wake-up only comes through the idle thread, which cannot run
+		 * before this thread blocks with preemption disabled.
+		 */
+		if (uthread_rt.to_preempt)
+			preempt_disable();
+		if (__atomic_compare_exchange_n(&job->state, &running,
+										PARALLEL_PARKED, false,
+										__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			uthread_block();
+		preempt_enable();
+		uthread_runtime_release(rt);
+	}
+
+	// Unused accumulators are left as copies of the identity
+	for (int i = 0; join && i < job->nr_slots; i++)
+		join(result, job->accs + i * job->acc_stride, arg);
+	parallel_put(job);
+	return 0;
+}
+
+int parallel_for(long begin, long end, long grain, parallel_func_t func,
+				 void *arg)
+{
+	if (!func)
+		return -1;
+	return parallel_run(begin, end, grain, func, NULL, NULL, NULL, 0, arg);
+}
+
+int parallel_reduce(long begin, long end, long grain, parallel_acc_func_t func,
+					parallel_join_func_t join, void *result, size_t size,
+					void *arg)
+{
+	if (!func || !join || !result || !size)
+		return -1;
+	return parallel_run(begin, end, grain, NULL, func, join, result, size,
+						arg);
+}
@@ -0,0 +1,92 @@
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include <stddef.h>
+
+/*
+ * Parallel loops
+ *
+ * parallel_for() and parallel_reduce() run a function over a range of
+ * indices, in chunks, on all the runtimes in uthread_run() (see
+ * uthread_run()): the calling thread works through the range from its start,
+ * while each other runtime gets a helper thread stealing the upper half of
+ * what is left to a participant, and working through that in turn. Helpers
+ * steal from participants on their own NUMA node first (see
+ * uthread_runtime_node()).
+ *
+ * Only runtimes with nothing else to do, or whose threads yield regularly,
+ * are of any help: runtimes are meant to be kept alive for that, e.g. with
+ * uthread_runtime_hold(). Whatever the number of items, a call allocates
+ * nothing but its bookkeeping, and creates one helper thread per runtime.
+ */
+
+/*
+ * parallel_func_t - Function run over a chunk of a range
+ * @begin: First index of the chunk
+ * @end: Index right after the last one of the chunk
+ * @arg: Argument passed to parallel_for()
+ */
+typedef void (*parallel_func_t)(long begin, long end, void *arg);
+
+/*
+ * parallel_acc_func_t - Function accumulating a chunk of a range
+ * @begin: First index of the chunk
+ * @end: Index right after the last one of the chunk
+ * @acc: Accumulator of the participant running the chunk
+ * @arg: Argument passed to parallel_reduce()
+ */
+typedef void (*parallel_acc_func_t)(long begin, long end, void *acc, void *arg);
+
+/*
+ * parallel_join_func_t - Function combining two accumulators
+ * @acc: Accumulator to combine into
+ * @other: Accumulator to combine with
+ * @arg: Argument passed to parallel_reduce()
+ */
+typedef void (*parallel_join_func_t)(void *acc, const void *other, void *arg);
+
+/*
+ * parallel_for - Run a function over a range in parallel
+ * @begin: First index of the range
+ * @end: Index right after the last one of the range
+ * @grain: Number of indices per chunk, or 0 to let it be picked from the size
+ *	of the range and the number of runtimes
+ * @func: Function to run over each chunk
+ * @arg: Argument to be passed to @func
+ *
+ * Each index of the range is part of exactly one chunk, chunks running in no
+ * particular order and from any runtime. Each chunk spends a unit of the yield
+ * budget of the thread running it (see uthread_consume_budget()).
+ *
+ * Return: -1 if @func is NULL, if @grain is negative, if not called from a
+ * thread, or in case of failure when allocating the bookkeeping. 0 once @func
+ * ran over the whole range.
+ */
+int parallel_for(long begin, long end, long grain, parallel_func_t func,
+				 void *arg);
+
+/*
+ * parallel_reduce - Reduce a range in parallel
+ * @begin: First index of the range
+ * @end: Index right after the last one of the range
+ * @grain: Number of indices per chunk, or 0 to let it be picked
+ * @func: Function accumulating each chunk
+ * @join: Function combining the accumulators of the participants
+ * @result: Identity of the reduction on entry, and its result on return
+ * @size: Size of an accumulator, in bytes
+ * @arg: Argument to be passed to @func and @join
+ *
+ * Each participant accumulates the chunks it runs into its own accumulator,
+ * starting from a copy of @result. These are joined into @result once the
+ * whole range was run over, in no particular order: @join must be associative
+ * and commutative.
+ *
+ * Return: -1 if @func, @join or @result is NULL, if @size is 0, if @grain is
+ * negative, if not called from a thread, or in case of failure when allocating
+ * the bookkeeping. 0 once @result holds the reduction of the whole range.
+ */
+int parallel_reduce(long begin, long end, long grain, parallel_acc_func_t func,
+					parallel_join_func_t join, void *result, size_t size,
+					void *arg);
+
+#endif /* _PARALLEL_H */
@@ -0,0 +1,236 @@
+#include <stdlib.h>
+
+#include "pq.h"
+
+/*
+ * The priority queue is a 4-ary min-heap stored in a flat array: the children
+ * of slot i are slots 4i+1 to 4i+4. Compared to a binary heap it is half as
+ * deep and the four children of a slot usually share a cache line, which is
+ * what matters when sifting down.
+ *
+ * Each slot keeps the data pointer itself (so that comparisons do not need to
+ * go through the node) and the node backing the item's handle, which only
+ * remembers where the item currently is in the array.
+ */
+#define PQ_ARITY 4
+#define PQ_INIT_CAPACITY 16
+
+/* Spare nodes, pooled as in queue.c */
+#define PQ_SPARE_MAX 32
+
+struct pq_node
+{
+	int index;
+	struct pq_node *next_spare;
+};
+
+struct pq_entry
+{
+	void *data;
+	struct pq_node *node;
+};
+
+struct pq
+{
+	pq_cmp_t cmp;
+	struct pq_entry *heap;
+	int size;
+	int capacity;
+	struct pq_node *spare;
+	int nr_spare;
+};
+
+pq_t pq_create(pq_cmp_t cmp)
+{
+	if (!cmp)
+		return NULL;
+
+	pq_t pq = malloc(sizeof(struct pq));
+	if (!pq)
+		return NULL;
+
+	pq->heap = malloc(PQ_INIT_CAPACITY * sizeof(struct pq_entry));
+	if (!pq->heap)
+	{
+		free(pq);
+		return NULL;
+	}
+	pq->cmp = cmp;
+	pq->size = 0;
+	pq->capacity = PQ_INIT_CAPACITY;
+	pq->spare = NULL;
+	pq->nr_spare = 0;
+	return pq;
+}
+
+int pq_destroy(pq_t pq)
+{
+	if (!pq || pq->size)
+		return -1;
+
+	while (pq->spare)
+	{
+		struct pq_node *tmp = pq->spare;
+		pq->spare = tmp->next_spare;
+		free(tmp);
+	}
+	free(pq->heap);
+	free(pq);
+	return 0;
+}
+
+static void pq_set(pq_t pq, int i, struct pq_entry e)
+{
+	pq->heap[i] = e;
+	e.node->index = i;
+}
+
+static void pq_sift_up(pq_t pq, int i)
+{
+	struct pq_entry e = pq->heap[i];
+
+	while (i > 0)
+	{
+		int parent = (i - 1) / PQ_ARITY;
+		if (pq->cmp(e.data, pq->heap[parent].data) >= 0)
+			break;
+		pq_set(pq, i, pq->heap[parent]);
+		i = parent;
+	}
+	pq_set(pq, i, e);
+}
+
+static void pq_sift_down(pq_t pq, int i)
+{
+	struct pq_entry e = pq->heap[i];
+
+	while (1)
+	{
+		int first = PQ_ARITY * i + 1;
+		if (first >= pq->size)
+			break;
+
+		// Find the smallest of the (up to) PQ_ARITY children
+		int last = first + PQ_ARITY < pq->size ? first + PQ_ARITY : pq->size;
+		int min = first;
+		for (int c = first + 1; c < last; c++)
+			if (pq->cmp(pq->heap[c].data, pq->heap[min].data) < 0)
+				min = c;
+
+		if (pq->cmp(pq->heap[min].data, e.data) >= 0)
+			break;
+		pq_set(pq, i, pq->heap[min]);
+		i = min;
+	}
+	pq_set(pq, i, e);
+}
+
+/*
+ * pq_remove_at - Take out the item in slot @i and release its node
+ */
+static void pq_remove_at(pq_t pq, int i)
+{
+	struct pq_node *node = pq->heap[i].node;
+
+	pq->size--;
+	if (i != pq->size)
+	{
+		// Fill the hole with the last item and move it where it belongs
+		pq_set(pq, i, pq->heap[pq->size]);
+		int parent = (i - 1) / PQ_ARITY;
+		if (i > 0 && pq->cmp(pq->heap[i].data, pq->heap[parent].data) < 0)
+			pq_sift_up(pq, i);
+		else
+			pq_sift_down(pq, i);
+	}
+
+	if (pq->nr_spare >= PQ_SPARE_MAX)
+	{
+		free(node);
+		return;
+	}
+	node->next_spare = pq->spare;
+	pq->spare = node;
+	pq->nr_spare++;
+}
+
+int pq_insert(pq_t pq, void *data, pq_handle_t *handle)
+{
+	if (!pq || !data)
+		return -1;
+
+	if (pq->size == pq->capacity)
+	{
+		size_t bytes = 2 * pq->capacity * sizeof(struct pq_entry);
+		struct pq_entry *heap = realloc(pq->heap, bytes);
+		if (!heap)
+			return -1;
+		pq->heap = heap;
+		pq->capacity *= 2;
+	}
+
+	struct pq_node *node = pq->spare;
+	if (node)
+	{
+		pq->spare = node->next_spare;
+		pq->nr_spare--;
+	}
+	else
+	{
+		node = malloc(sizeof(struct pq_node));
+		if (!node)
+			return -1;
+	}
+
+	struct pq_entry e = {data, node};
+	pq_set(pq, pq->size++, e);
+	pq_sift_up(pq, pq->size - 1);
+
+	if (handle)
+		*handle = node;
+	return 0;
+}
+
+int pq_peek(pq_t pq, void **data)
+{
+	if (!pq || !data || !pq->size)
+		return -1;
+
+	*data = pq->heap[0].data;
+	return 0;
+}
+
+int pq_extract_min(pq_t pq, void **data)
+{
+	if (!pq || !data || !pq->size)
+		return -1;
+
+	*data = pq->heap[0].data;
+	pq_remove_at(pq, 0);
+	return 0;
+}
+
+int pq_decrease_key(pq_t pq, pq_handle_t handle)
+{
+	if (!pq || !handle)
+		return -1;
+
+	pq_sift_up(pq, handle->index);
+	return 0;
+}
+
+int pq_remove_handle(pq_t pq, pq_handle_t handle)
+{
+	if (!pq || !handle)
+		return -1;
+
+	pq_remove_at(pq, handle->index);
+	return 0;
+}
+
+int pq_length(pq_t pq)
+{
+	if (!pq)
+		return -1;
+	return pq->size;
+}
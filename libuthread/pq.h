@@ -0,0 +1,124 @@
+#ifndef _PQ_H
+#define _PQ_H
+
+/*
+ * pq_t - Priority queue type
+ *
+ * A priority queue orders its data items with a comparison function given at
+ * creation time. Extracting from the priority queue always returns the
+ * smallest item first (ie the one that compares before all the others). Items
+ * that compare equal come out in no particular order.
+ *
+ * Insert, extract, decrease-key and remove operations are O(log n), peek and
+ * length operations are O(1).
+ */
+typedef struct pq *pq_t;
+
+/*
+ * pq_handle_t - Priority queue item handle
+ *
+ * Opaque reference to one item of a priority queue, as returned by
+ * pq_insert(). A handle stays valid only while its item is in the priority
+ * queue: once the item is extracted or removed, the handle must not be used
+ * anymore.
+ */
+typedef struct pq_node *pq_handle_t;
+
+/*
+ * pq_cmp_t - Priority queue comparison function type
+ * @a: First data item
+ * @b: Second data item
+ *
+ * Return: A negative value if @a must be extracted before @b, a positive value
+ * if @b must be extracted before @a, 0 if they are equivalent.
+ */
+typedef int (*pq_cmp_t)(const void *a, const void *b);
+
+/*
+ * pq_create - Allocate an empty priority queue
+ * @cmp: Function used to order the items
+ *
+ * Return: Pointer to new empty priority queue. NULL if @cmp is NULL or in case
+ * of failure when allocating the new priority queue.
+ */
+pq_t pq_create(pq_cmp_t cmp);
+
+/*
+ * pq_destroy - Deallocate a priority queue
+ * @pq: Priority queue to deallocate
+ *
+ * Return: -1 if @pq is NULL or if @pq is not empty. 0 if @pq was successfully
+ * destroyed.
+ */
+int pq_destroy(pq_t pq);
+
+/*
+ * pq_insert - Insert data item
+ * @pq: Priority queue in which to insert item
+ * @data: Address of data item to insert
+ * @handle: Address where to store the handle of the new item, or NULL
+ *
+ * Return: -1 if @pq or @data are NULL, or in case of memory allocation error
+ * when inserting. 0 if @data was successfully inserted in @pq.
+ */
+int pq_insert(pq_t pq, void *data, pq_handle_t *handle);
+
+/*
+ * pq_peek - Get smallest data item
+ * @pq: Priority queue to look into
+ * @data: Address of data pointer where item is received
+ *
+ * Assign the smallest item of @pq to @data, without removing it.
+ *
+ * Return: -1 if @pq or @data are NULL, or if @pq is empty. 0 if @data was set
+ * with the smallest item of @pq.
+ */
+int pq_peek(pq_t pq, void **data);
+
+/*
+ * pq_extract_min - Extract smallest data item
+ * @pq: Priority queue from which to extract item
+ * @data: Address of data pointer where item is received
+ *
+ * Remove the smallest item of @pq and assign it to @data.
+ *
+ * Return: -1 if @pq or @data are NULL, or if @pq is empty. 0 if @data was set
+ * with the smallest item of @pq.
+ */
+int pq_extract_min(pq_t pq, void **data);
+
+/*
+ * pq_decrease_key - Reorder an item whose key decreased
+ * @pq: Priority queue in which the item is
+ * @handle: Handle of the item, as returned by pq_insert()
+ *
+ * To be called after the key of the item referred to by @handle was changed
+ * so that the item compares smaller than before (e.g. an earlier deadline).
+ * The item must still be in @pq, otherwise the behavior is undefined.
+ *
+ * Return: -1 if @pq or @handle are NULL. 0 if the item was moved to its new
+ * place.
+ */
+int pq_decrease_key(pq_t pq, pq_handle_t handle);
+
+/*
+ * pq_remove_handle - Remove an item through its handle
+ * @pq: Priority queue in which the item is
+ * @handle: Handle of the item, as returned by pq_insert()
+ *
+ * Remove the item referred to by @handle from @pq, wherever it is. The item
+ * must still be in @pq, otherwise the behavior is undefined.
+ *
+ * Return: -1 if @pq or @handle are NULL. 0 if the item was removed from @pq.
+ */
+int pq_remove_handle(pq_t pq, pq_handle_t handle);
+
+/*
+ * pq_length - Priority queue length
+ * @pq: Priority queue to get the length of
+ *
+ * Return: -1 if @pq is NULL. Length of @pq otherwise.
+ */
+int pq_length(pq_t pq);
+
+#endif /* _PQ_H */
@@ -1,4 +1,5 @@
-#define _POSIX_SOURCE
+#define _XOPEN_SOURCE 700
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -66,14 +67,25 @@ bool preempt_disabled(void)
     return false;
 }
 
+/*
+ * The timer and the signal action belong to the whole process: the first
+ * runtime to start preemption sets them up, the last one to stop it puts the
+ * previous ones back
+ */
+static pthread_mutex_t preempt_lock = PTHREAD_MUTEX_INITIALIZER;
+static int nr_preempt_runtimes;
+static struct sigaction old_action;
+static struct itimerval old_timer;
+
 /*
  * timer_handler - Timer signal handler (aka interrupt handler)
  * @signo - Received signal number (can be ignored)
  */
 static void timer_handler(int signo)
 {
+    (void)signo;
     // Force currently running thread to yield.
-    uthread_yield();
+    uthread_preempt();
 }
 
 void preempt_start(bool preempt)
@@ -83,15 +95,22 @@ void preempt_start(bool preempt)
     struct sigaction sa;
     struct itimerval it;
 
+    pthread_mutex_lock(&preempt_lock);
+    if (nr_preempt_runtimes++)
+    {
+        pthread_mutex_unlock(&preempt_lock);
+        return;
+    }
+
     /*
      * Install signal handler @timer_handler for dealing with alarm signals
      */
     sa.sa_handler = timer_handler;
     sigemptyset(&sa.sa_mask);
     /* Make functions such as read() or write() to restart instead of
-     * failing when interrupted */
-    // sa.sa_flags = SA_RESTART;
-    if (sigaction(SIGVTALRM, &sa, NULL))
+     * failing when interrupted, the signal reaching any kernel thread */
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(SIGVTALRM, &sa, &old_action))
     {
         perror("sigaction");
         exit(1);
@@ -104,14 +123,24 @@ void preempt_start(bool preempt)
     it.it_value.tv_usec = 1000000 / HZ;
     it.it_interval.tv_sec = 0;
     it.it_interval.tv_usec = 1000000 / HZ;
-    if (setitimer(ITIMER_VIRTUAL, &it, NULL))
+    if (setitimer(ITIMER_VIRTUAL, &it, &old_timer))
     {
         perror("setitimer");
         exit(1);
     }
+    pthread_mutex_unlock(&preempt_lock);
 }
 
 void preempt_stop(void)
 {
-    return;
+    if (!uthread_rt.to_preempt)
+        return;
+
+    pthread_mutex_lock(&preempt_lock);
+    if (!--nr_preempt_runtimes)
+    {
+        setitimer(ITIMER_VIRTUAL, &old_timer, NULL);
+        sigaction(SIGVTALRM, &old_action, NULL);
+    }
+    pthread_mutex_unlock(&preempt_lock);
 }
@@ -12,6 +12,10 @@
  */
 #include <ucontext.h>
 
+#include "hist.h"
+#include "pq.h"
+#include "queue.h"
+#include "sem.h"
 #include "uthread.h"
 
 /*
@@ -34,31 +38,151 @@ typedef ucontext_t uthread_ctx_t;
  */
 void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next);
 
+/*
+ * UTHREAD_STACK_SIZE - Default size of the stack of a thread (in bytes)
+ */
+#define UTHREAD_STACK_SIZE 32768
+
 /*
  * uthread_ctx_alloc_stack - Allocate stack segment
+ * @size: Size of the stack segment, in bytes
+ * @flags: UTHREAD_STACK_* flags of the thread
+ *
+ * With UTHREAD_STACK_GROWABLE, @size is only reserved in the address space,
+ * pages being committed as the thread touches them, and an inaccessible guard
+ * page is placed right below the segment.
  *
  * Return: Pointer to the top of a valid stack segment, or NULL in case of
  * failure
  */
-void *uthread_ctx_alloc_stack(void);
+void *uthread_ctx_alloc_stack(size_t size, unsigned int flags);
+
+/*
+ * uthread_ctx_paint_stack - Fill a stack segment with a known pattern
+ * @top_of_stack: Address of the stack segment
+ * @size: Size of the stack segment, in bytes
+ */
+void uthread_ctx_paint_stack(void *top_of_stack, size_t size);
+
+/*
+ * uthread_ctx_stack_used - Measure how deep a stack was used
+ * @top_of_stack: Address of a stack segment, painted with
+ *	uthread_ctx_paint_stack() unless it is growable
+ * @size: Size of the stack segment, in bytes
+ * @flags: UTHREAD_STACK_* flags the stack was allocated with
+ *
+ * Growable stacks are not painted, as that would commit all of their pages:
+ * their usage is instead the span of their resident pages, so it is only
+ * precise to the page.
+ *
+ * Return: Number of bytes of the stack segment that were used
+ */
+size_t uthread_ctx_stack_used(void *top_of_stack, size_t size,
+							  unsigned int flags);
+
+/*
+ * UTHREAD_SHARED_STACK_SIZE - Size of the stack shared by threads created with
+ * UTHREAD_STACK_SHARED (in bytes)
+ */
+#define UTHREAD_SHARED_STACK_SIZE (256 * 1024)
+
+/*
+ * struct uthread_shared_ctx - State of a thread running on the shared stack
+ * @ctx: Execution context of the thread
+ * @func: Function to be executed by the thread
+ * @arg: Argument to pass to the thread
+ * @started: Whether @ctx was set up yet, which can only be done once the
+ *	thread gets the shared stack
+ * @sp: Lowest address of the live part of the stack, as of the last time the
+ *	thread was switched out
+ * @buf: Copy of the live part of the stack while another thread uses it
+ * @len: Number of bytes saved in @buf
+ * @cap: Size of @buf
+ */
+struct uthread_shared_ctx
+{
+	uthread_ctx_t *ctx;
+	uthread_func_t func;
+	void *arg;
+	bool started;
+	char *sp;
+	void *buf;
+	size_t len;
+	size_t cap;
+};
+
+/*
+ * uthread_ctx_shared_init - Initialize the context of a thread running on the
+ * shared stack
+ * @sctx: Shared context to initialize
+ * @uctx: Execution context of the thread
+ * @func: Function to be executed by the thread
+ * @arg: Argument to pass to the thread
+ *
+ * Return: 0 if @sctx was properly initialized, or -1 in case of failure
+ */
+int uthread_ctx_shared_init(struct uthread_shared_ctx *sctx, uthread_ctx_t *uctx,
+							uthread_func_t func, void *arg);
+
+/*
+ * uthread_ctx_switch_shared - Switch between two execution contexts, either of
+ * them running on the shared stack
+ * @prev: Execution context in which to save the currently running thread
+ * @prev_shared: Shared context of the current thread, or NULL if it does not
+ *	run on the shared stack or is exiting
+ * @next: Execution context to resume
+ * @next_shared: Shared context of the thread to resume, or NULL if it does not
+ *	run on the shared stack
+ *
+ * If the thread to resume does not have the shared stack, the switch goes
+ * through a context with its own stack, which saves the live part of the
+ * stack of the current owner and copies back the one of @next.
+ */
+void uthread_ctx_switch_shared(uthread_ctx_t *prev,
+							   struct uthread_shared_ctx *prev_shared,
+							   uthread_ctx_t *next,
+							   struct uthread_shared_ctx *next_shared);
+
+/*
+ * uthread_ctx_shared_exit - Release the resources of an exiting thread running
+ * on the shared stack
+ * @sctx: Shared context of the exiting thread
+ *
+ * The thread may keep running on the shared stack until it switches out for
+ * the last time, but its stack is not saved anymore.
+ */
+void uthread_ctx_shared_exit(struct uthread_shared_ctx *sctx);
+
+/*
+ * uthread_ctx_shared_reset - Free the shared stack at the end of uthread_run()
+ *
+ * Threads left on the shared stack are never resumed. The stacks of the
+ * runtime are allocated again by the next thread created with
+ * UTHREAD_STACK_SHARED.
+ */
+void uthread_ctx_shared_reset(void);
 
 /*
  * uthread_ctx_destroy_stack - Deallocate stack segment
  * @top_of_stack: Address of stack to deallocate
+ * @size: Size of the stack segment, in bytes
+ * @flags: UTHREAD_STACK_* flags the stack was allocated with
  */
-void uthread_ctx_destroy_stack(void *top_of_stack);
+void uthread_ctx_destroy_stack(void *top_of_stack, size_t size,
+							   unsigned int flags);
 
 /*
  * uthread_ctx_init - Initialize a thread's execution context
  * @uctx: Pointer to thread context to initialize
  * @top_of_stack: Pointer to the top of a valid stack segment, as allocated by
  *	uthread_ctx_alloc_stack()
+ * @stack_size: Size of the stack segment, in bytes
  * @func: Function to be executed by the thread
  * @arg: Argument to pass to the thread
  *
  * Return: 0 if @uctx was properly initialized, or -1 in case of failure
  */
-int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
+int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack, size_t stack_size,
 					 uthread_func_t func, void *arg);
 
 
@@ -75,6 +199,10 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
  *
  * If @preempt is false, don't start preemption; all the other functions from
  * the preemption API should then be ineffective.
+ *
+ * The timer and the handler are shared by all the kernel threads of the
+ * process: they are set up by the first runtime starting preemption, and the
+ * alarms may reach any kernel thread not blocking them.
  */
 void preempt_start(bool preempt);
 
@@ -82,7 +210,8 @@ void preempt_start(bool preempt);
  * preempt_stop - Stop thread preemption
  *
  * Restore previous timer configuration, and previous action associated to
- * virtual alarm signals.
+ * virtual alarm signals, once the last runtime that started preemption stops
+ * it. Does nothing in a runtime that did not start preemption.
  */
 void preempt_stop(void);
 
@@ -114,15 +243,434 @@ struct uthread_tcb;
  */
 struct uthread_tcb *uthread_current(void);
 
+/*
+ * uthread_preempt - Force currently running thread to yield
+ *
+ * Same as uthread_yield(), but accounted for as a preemption. Meant to be
+ * called from the preemption timer handler, which may run in any kernel
+ * thread: only a thread of a preemptive runtime, other than its idle thread,
+ * is forced out.
+ */
+void uthread_preempt(void);
+
+/*
+ * uthread_clock_ns - Get monotonic time used for statistics, in nanoseconds
+ */
+unsigned long long uthread_clock_ns(void);
+
+/*
+ * struct uthread_runtime - State of the runtime of a kernel thread
+ * @curr_thd: Currently running thread
+ * @idle_thd: Idle thread of uthread_run()
+ * @placeholder_zombie: Last exited thread, freed once switched out of
+ * @next_tid: Identifier of the next thread created
+ * @ready_q: Threads ready to run
+ * @run_next: Thread woken last, elected before those of @ready_q
+ * @run_next_streak: Number of times in a row the thread elected was taken from
+ *	@run_next
+ * @all_threads: Threads not exited yet
+ * @timers: Armed timers (sleeps and deadlines), soonest first
+ * @to_preempt: Whether preemption was requested to uthread_run()
+ * @pinned: Whether uthread_run_attr() pinned the kernel thread to @cpu
+ * @cpu: CPU the kernel thread is pinned to
+ * @node: NUMA node of @cpu
+ * @stats: Runtime-wide statistics
+ * @run_start_ts: When uthread_run() started
+ * @latency_hists: Scheduling latency histograms
+ * @running: Whether uthread_run() is running, read by other kernel threads
+ * @holds: Number of holds keeping the runtime alive while idle
+ * @sleeping: Whether the runtime is waiting on @doorbell, or about to
+ * @doorbell: Eventfd signaled to wake the runtime up when it waits
+ * @inbox: Tasks sent by other runtimes, in reverse order of sending
+ * @wakeups: Threads unblocked by other runtimes, in reverse order
+ * @offload_done: Offloaded functions completed, in reverse order of completion
+ * @nr_offloads: Offloaded functions not collected yet
+ * @pins: Number of kernel threads about to wake the runtime up, which must not
+ *	go away until they are done
+ * @next: Next runtime in uthread_run(), see runtime_pin_others()
+ *
+ * Each kernel thread has its own runtime, so that several runtimes can run
+ * side by side without sharing anything but what is sent from one to another.
+ * Fields from @running on may be accessed by other kernel threads, and only
+ * with atomic operations, but for @next which is guarded by the lock of the
+ * list of runtimes.
+ */
+struct uthread_runtime
+{
+	struct uthread_tcb *curr_thd;
+	struct uthread_tcb *idle_thd;
+	struct uthread_tcb *placeholder_zombie;
+	int next_tid;
+	queue_t ready_q;
+	struct uthread_tcb *run_next;
+	unsigned int run_next_streak;
+	queue_t all_threads;
+	pq_t timers;
+	bool to_preempt;
+	bool pinned;
+	int cpu;
+	int node;
+	struct uthread_stats stats;
+	unsigned long long run_start_ts;
+	struct hist latency_hists[UTHREAD_LATENCY_MAX];
+
+	bool running;
+	int holds;
+	bool sleeping;
+	int doorbell;
+	struct runtime_msg *inbox;
+	struct uthread_tcb *wakeups;
+	struct offload_job *offload_done;
+	unsigned long nr_offloads;
+	int pins;
+	struct uthread_runtime *next;
+};
+
+/*
+ * uthread_rt - Runtime of the calling kernel thread
+ */
+extern __thread struct uthread_runtime uthread_rt;
+
+/*
+ * cpu_relax - Tell the CPU the caller is busy waiting
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define cpu_relax() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/*
+ * runtime_start - Make the runtime of the calling kernel thread reachable
+ *
+ * Return: -1 in case of failure when creating its doorbell, 0 otherwise
+ */
+int runtime_start(void);
+
+/*
+ * runtime_stop - Make the runtime of the calling kernel thread unreachable
+ */
+void runtime_stop(void);
+
+/*
+ * runtime_poll - Create threads for the tasks sent to the runtime
+ */
+void runtime_poll(void);
+
+/*
+ * runtime_wait - Wait until something happens to the idle runtime
+ * @timeout_ns: Longest time to wait, in nanoseconds, or -1 for no limit
+ * @holds_only: Whether the runtime waits for nothing but its holds, no
+ *	offloaded function or timer being pending
+ *
+ * Return when a task was sent to the runtime, an offloaded function completed,
+ * a thread was woken up by another runtime, a hold was released, or after
+ * @timeout_ns. A runtime that is not held only returns right away if
+ * @holds_only, as it is otherwise still waiting for something else.
+ */
+void runtime_wait(long long timeout_ns, bool holds_only);
+
+/*
+ * runtime_pin - Keep a runtime from going away
+ * @rt: Runtime about to be given something from another kernel thread
+ *
+ * Once what it waits for is made available, @rt may leave uthread_run() at any
+ * time. Pinning it beforehand makes it wait in uthread_run() until the kernel
+ * thread giving it work is done ringing it, and unpins it.
+ */
+void runtime_pin(struct uthread_runtime *rt);
+
+/*
+ * runtime_unpin - Let a pinned runtime go away
+ * @rt: Runtime pinned with runtime_pin()
+ */
+void runtime_unpin(struct uthread_runtime *rt);
+
+/*
+ * runtime_pin_others - Pin the other runtimes in uthread_run()
+ * @rts: Array where to store the runtimes pinned
+ * @max: Largest number of runtimes to pin
+ *
+ * Each of the runtimes pinned must be unpinned with runtime_unpin().
+ *
+ * Return: Number of runtimes pinned, all running besides the caller's own
+ */
+int runtime_pin_others(struct uthread_runtime **rts, int max);
+
+/*
+ * runtime_ring - Wake a runtime up if it waits
+ * @rt: Pinned runtime to wake up, after making what it waits for available
+ */
+void runtime_ring(struct uthread_runtime *rt);
+
+/*
+ * stack_usage_record - Account for the stack usage of an exiting thread
+ * @func: Function the thread was created with
+ * @stack_size: Size of the thread's stack
+ * @used: Number of bytes of stack the thread used
+ */
+void stack_usage_record(uthread_func_t func, size_t stack_size, size_t used);
+
+/*
+ * stack_guard_install - Catch overflows of growable stacks
+ *
+ * Install, once per process, a SIGSEGV handler running on an alternate signal
+ * stack, itself installed once per kernel thread. The handler reports faults
+ * in the guard page of the running thread as a stack overflow of that thread
+ * before letting the process crash, and hands other faults over to the
+ * handler the process had before.
+ *
+ * Return: -1 in case of failure, 0 otherwise
+ */
+int stack_guard_install(void);
+
+/*
+ * stack_guard_reset - Put back the alternate signal stack of the application
+ *
+ * Called at the end of uthread_run(), once no growable stack is left. Frees the
+ * alternate signal stack of the calling kernel thread, if stack_guard_install()
+ * set one, and restores the one the kernel thread had before. The SIGSEGV
+ * handler stays, and the next stack_guard_install() sets a new alternate stack.
+ */
+void stack_guard_reset(void);
+
+/*
+ * uthread_stack_overflowed - Check whether a fault is a stack overflow
+ * @addr: Faulting address
+ *
+ * Return: Identifier of the running thread if @addr is in the guard page of its
+ * stack, -1 otherwise
+ */
+int uthread_stack_overflowed(void *addr);
+
+/*
+ * coro_runtime_reset - Forget the coroutines left at the end of uthread_run()
+ *
+ * Coroutines still waiting when the last thread is gone are never resumed,
+ * and their executor thread, blocked, is gone with the others.
+ */
+void coro_runtime_reset(void);
+
+/*
+ * offload_poll - Wake up the threads whose offloaded function completed
+ *
+ * Return: Number of threads woken up
+ */
+int offload_poll(void);
+
+/*
+ * uthread_ctx_borrow - Change the context of the currently running thread
+ * @ctx: Context in which to save the thread when it is switched out, and from
+ *	which to resume it
+ *
+ * Used to run something else than the thread's function on the thread's
+ * behalf, such as a generator, which then gets switched out and resumed if it
+ * blocks.
+ *
+ * Return: Previous context of the thread, or NULL if not called from a thread
+ */
+uthread_ctx_t *uthread_ctx_borrow(uthread_ctx_t *ctx);
+
+/*
+ * uthread_generator - Get the generator run by the current thread
+ *
+ * Return: Innermost generator currently run by the calling thread, or NULL
+ */
+struct generator *uthread_generator(void);
+
+/*
+ * uthread_set_generator - Set the generator run by the current thread
+ * @gen: Generator the calling thread now runs, or NULL
+ */
+void uthread_set_generator(struct generator *gen);
+
+/*
+ * uthread_waiter - Get the semaphore waiter of the currently running thread
+ *
+ * The waiter is part of the thread's TCB, rather than on its stack which may
+ * be moved away while the thread is blocked (see UTHREAD_STACK_SHARED). Waking
+ * it up unblocks the thread.
+ */
+struct sem_waiter *uthread_waiter(void);
+
 /*
  * uthread_block - Block currently running thread
  */
 void uthread_block(void);
 
+/*
+ * UTHREAD_RUN_NEXT_MAX - Number of times in a row threads can be elected from
+ * the run-next slot, before the thread at the head of the ready queue gets its
+ * turn
+ */
+#define UTHREAD_RUN_NEXT_MAX 16
+
 /*
  * uthread_unblock - Unblock thread
  * @uthread: TCB of thread to unblock
+ *
+ * When woken by another thread than the idle one, @uthread takes the run-next
+ * slot, to be elected at the next switch while what its waker just handed it
+ * is still in cache. A thread it displaces goes to the tail of the ready queue.
+ * Threads keeping on waking each other up only skip the queue
+ * UTHREAD_RUN_NEXT_MAX times in a row.
  */
 void uthread_unblock(struct uthread_tcb *uthread);
 
+/*
+ * uthread_unblock_all - Unblock a queue of threads at once
+ * @queue: Queue of the TCBs of blocked threads of the runtime, left empty
+ *
+ * The threads are moved to the tail of the ready queue, in order, with a
+ * single splice rather than one uthread_unblock() each. They do not take the
+ * run-next slot: none of them is more likely than the others to use what was
+ * handed to them while it is still in cache.
+ */
+void uthread_unblock_all(queue_t queue);
+
+/*
+ * uthread_cancel_pending - Check for cancellation at a cancellation point
+ *
+ * Return: true, with errno set to ECANCELED, if the running thread was
+ * cancelled. false otherwise.
+ */
+bool uthread_cancel_pending(void);
+
+/*
+ * uthread_block_sem - Block currently running thread on a semaphore
+ * @sem: Semaphore the thread waits on, with its waiter queued
+ *
+ * Same as uthread_block(), except that cancelling the thread meanwhile takes
+ * its waiter out of the queue of @sem and unblocks it.
+ *
+ * Return: -1, with errno set to ECANCELED, if the wait was cancelled. 0 if the
+ * semaphore was handed over to the thread.
+ */
+int uthread_block_sem(sem_t sem);
+
+/*
+ * sem_cancel_wait - Take a waiter out of the queue of a semaphore
+ * @sem: Semaphore the waiter waits on
+ * @waiter: Waiter to take out
+ *
+ * Return: -1 if @waiter is not queued anymore, the semaphore being handed
+ * over to it already. 0 otherwise.
+ */
+int sem_cancel_wait(sem_t sem, struct sem_waiter *waiter);
+
+/*
+ * uthread_poll_wakeups - Unblock the threads woken up by other runtimes
+ *
+ * A thread waiting on a semaphore released from another runtime is handed
+ * back to its own runtime, which unblocks it from its idle thread.
+ */
+void uthread_poll_wakeups(void);
+
+/*
+ * uthread_cancel_tcb - Cancel a thread of the runtime
+ * @tcb: TCB of the thread to cancel
+ *
+ * Same as uthread_cancel(), for a thread already at hand.
+ */
+void uthread_cancel_tcb(struct uthread_tcb *tcb);
+
+/*
+ * uthread_spawn - Create a thread whose TCB is left to its creator
+ * @func: Function to be executed by the thread
+ * @arg: Argument to be passed to the thread
+ *
+ * Same as uthread_create(), except that the thread is not freed when it exits.
+ * Its creator frees it with uthread_reap() instead, once it knows the thread
+ * exited and was switched out of, e.g. by running after the thread exited.
+ *
+ * Return: TCB of the new thread, or NULL in case of failure
+ */
+struct uthread_tcb *uthread_spawn(uthread_func_t func, void *arg);
+
+/*
+ * uthread_reap - Free an exited thread created with uthread_spawn()
+ * @tcb: TCB of the thread, with its stack
+ */
+void uthread_reap(struct uthread_tcb *tcb);
+
+struct group;
+
+/*
+ * uthread_block_group - Block currently running thread on a task group
+ * @group: Group whose children the thread waits for, in group_wait()
+ *
+ * Same as uthread_block(), except that cancelling the thread meanwhile cancels
+ * the children of @group, the thread staying blocked until they exit.
+ */
+void uthread_block_group(struct group *group);
+
+/*
+ * group_cancel_children - Cancel the running children of a task group
+ * @group: Group whose children to cancel
+ *
+ * Preemption must be disabled by the caller.
+ */
+void group_cancel_children(struct group *group);
+
+
+/**
+ * Private tracing API
+ */
+#include <stdint.h>
+
+/*
+ * trace_type_t - Types of scheduling events
+ * @TRACE_SWITCH: Thread @tid switched to thread @arg
+ * @TRACE_CREATE: Thread @tid created thread @arg
+ * @TRACE_EXIT: Thread @tid exited
+ * @TRACE_BLOCK: Thread @tid blocked
+ * @TRACE_UNBLOCK: Thread @tid unblocked thread @arg
+ * @TRACE_SEM_WAIT: Thread @tid found semaphore @arg unavailable
+ * @TRACE_SEM_WAKE: Thread @tid released semaphore @arg to a waiting thread
+ */
+typedef enum
+{
+	TRACE_SWITCH,
+	TRACE_CREATE,
+	TRACE_EXIT,
+	TRACE_BLOCK,
+	TRACE_UNBLOCK,
+	TRACE_SEM_WAIT,
+	TRACE_SEM_WAKE,
+} trace_type_t;
+
+/*
+ * uthread_trace_on - Whether events are being recorded
+ */
+extern __thread bool uthread_trace_on;
+
+/*
+ * trace_record - Record a scheduling event, only valid while tracing is on
+ * @type: Type of event
+ * @tid: Identifier of the thread the event happened in
+ * @arg: Event argument, depends on @type
+ */
+void trace_record(trace_type_t type, int tid, uint64_t arg);
+
+/*
+ * trace_idle - Tell the tracer which thread is the idle thread
+ * @tid: Identifier of the idle thread of uthread_run()
+ *
+ * Kept after uthread_run() returns, so that a capture dumped then still names
+ * the track of the idle thread.
+ */
+void trace_idle(int tid);
+
+/*
+ * TRACE - Record a scheduling event if tracing is on
+ */
+#define TRACE(type, tid, arg)                          \
+	do                                                 \
+	{                                                  \
+		if (uthread_trace_on)                          \
+			trace_record((type), (tid), (uint64_t)(arg)); \
+	} while (0)
+
 #endif /* _UTHREAD_PRIVATE_H */
@@ -5,18 +5,29 @@
 
 #include "queue.h"
 
-struct node
+struct queue_node
 {
   void *data;
-  struct node *next;
+  struct queue_node *prev;
+  struct queue_node *next;
 };
-typedef struct node node;
+typedef struct queue_node node;
+
+/*
+ * Nodes unlinked from a queue are kept in a small per-queue pool and reused by
+ * the next enqueues, so that a queue going up and down around the same length
+ * (such as the ready queue) stops calling malloc() and free(). The pool is
+ * bounded so that a queue that was once long does not hold on to its memory.
+ */
+#define QUEUE_SPARE_MAX 32
 
 struct queue
 {
   node *front;
   node *rear;
   int size;
+  node *spare; // singly linked (through next) list of recycled nodes
+  int nr_spare;
 };
 
 queue_t queue_create(void)
@@ -27,6 +38,8 @@ queue_t queue_create(void)
   q->front = NULL;
   q->rear = NULL;
   q->size = 0;
+  q->spare = NULL;
+  q->nr_spare = 0;
   return q;
 }
 
@@ -44,10 +57,66 @@ int queue_destroy(queue_t queue)
   if (!queue || queue_length(queue)) // the queue is not empty(meaning there is
                                      // still data that hasn't been dequeued)
     return -1;
+  while (queue->spare)
+  {
+    node *tmp = queue->spare;
+    queue->spare = tmp->next;
+    free(tmp);
+  }
   free(queue);
   return 0;
 }
 
+/*
+ * queue_node_alloc - Get a node, reusing one of @queue's spare nodes if any
+ */
+static node *queue_node_alloc(queue_t queue)
+{
+  node *n = queue->spare;
+  if (!n)
+    return malloc(sizeof(node));
+  queue->spare = n->next;
+  queue->nr_spare--;
+  return n;
+}
+
+/*
+ * queue_node_free - Give back a node, keeping it as a spare if there is room
+ */
+static void queue_node_free(queue_t queue, node *n)
+{
+  if (queue->nr_spare >= QUEUE_SPARE_MAX)
+  {
+    free(n);
+    return;
+  }
+  n->next = queue->spare;
+  queue->spare = n;
+  queue->nr_spare++;
+}
+
+/*
+ * queue_unlink - Detach @n from @queue and release it
+ *
+ * Thanks to the back pointer, this works the same for the oldest, newest or
+ * any middle node and never needs to walk the list.
+ */
+static void queue_unlink(queue_t queue, node *n)
+{
+  if (n->prev)
+    n->prev->next = n->next;
+  else
+    queue->front = n->next;
+
+  if (n->next)
+    n->next->prev = n->prev;
+  else
+    queue->rear = n->prev;
+
+  queue->size--;
+  queue_node_free(queue, n);
+}
+
 /*
  * queue_enqueue - Enqueue data item
  * @queue: Queue in which to enqueue item
@@ -60,25 +129,39 @@ int queue_destroy(queue_t queue)
  */
 int queue_enqueue(queue_t queue, void *data)
 {
-  node *new_node = malloc(sizeof(node));
-  if (!queue || !new_node || !data)
+  return queue_enqueue_handle(queue, data, NULL);
+}
+
+/*
+ * queue_enqueue_handle - Enqueue data item and get a handle on it
+ * @queue: Queue in which to enqueue item
+ * @data: Address of data item to enqueue
+ * @handle: Where to store the handle of the new item (may be NULL)
+ *
+ * Return: -1 if @queue or @data are NULL, or in case of memory allocation error
+ * when enqueing. 0 if @data was successfully enqueued in @queue.
+ */
+int queue_enqueue_handle(queue_t queue, void *data, queue_handle_t *handle)
+{
+  if (!queue || !data)
+    return -1;
+
+  node *new_node = queue_node_alloc(queue);
+  if (!new_node)
     return -1;
 
   new_node->data = data;
-  new_node->next = NULL; // new_node->next is pointing at the end of the queue
-  if (!queue_length(queue))
-  { // if the queue is empty
-    queue->front = new_node;
-    queue->rear =
-        new_node; // front and rear of the queue will point at new_node
-  }
+  new_node->next = NULL;        // new_node is going to be the newest item
+  new_node->prev = queue->rear; // NULL if the queue is empty
+  if (queue->rear)
+    queue->rear->next = new_node; // link the previous newest item to new_node
   else
-  { // if the queue is not empty
-    queue->rear->next =
-        new_node;           // link the previous item in the queue to the new_node
-    queue->rear = new_node; // add new_node to the rear of the queue
-  }
+    queue->front = new_node; // empty queue, new_node is also the oldest item
+  queue->rear = new_node;
+
   queue->size++;
+  if (handle)
+    *handle = new_node;
   return 0;
 }
 
@@ -95,20 +178,11 @@ int queue_enqueue(queue_t queue, void *data)
  */
 int queue_dequeue(queue_t queue, void **data)
 {
-  if (!queue || !data || !queue_length(queue))
+  if (!queue || !data || !queue->front)
     return -1;
 
-  node *tmp = queue->front; // tmp is holding the address of the oldest item
-  *data = tmp->data;        // save the value of the oldest item into data
-  queue->front =
-      tmp->next; // now queue->front will point to the next oldest item
-
-  if (!queue->front) // if theres nothing left in queue, queue->rear should be
-                     // pointing at NULL
-    queue->rear = NULL;
-
-  queue->size--;
-  free(tmp);
+  *data = queue->front->data; // save the value of the oldest item into data
+  queue_unlink(queue, queue->front);
   return 0;
 }
 
@@ -125,54 +199,139 @@ int queue_dequeue(queue_t queue, void **data)
  */
 int queue_delete(queue_t queue, void *data)
 {
-  int found = -1;
-  if (!queue)
-    return found;
-  void *ptr;                     // dont care, used as arguments for queue_dequeue
-  node *previous = queue->front; // used to relink the nodes
-  node *tmp;                     // used to save the address pointing to the found item's node
-  if (queue->front->data == data)
-  { // if the oldest item's data matches
-    queue_dequeue(
-        queue,
-        (void **)&ptr); // just dequeue will delete and free the oldest node
-    previous = NULL;    // why not, doesnt hurt
-    found = 0;
+  if (!queue || !data)
+    return -1;
+
+  for (node *current = queue->front; current; current = current->next)
+  {
+    if (current->data == data)
+    {
+      queue_unlink(queue, current);
+      return 0;
+    }
   }
-  else
+  return -1;
+}
+
+/*
+ * queue_remove_handle - Remove an item through its handle
+ * @queue: Queue the item was enqueued in
+ * @handle: Handle returned by queue_enqueue_handle()
+ *
+ * Return: -1 if @queue or @handle are NULL. 0 if the item was removed.
+ */
+int queue_remove_handle(queue_t queue, queue_handle_t handle)
+{
+  if (!queue || !handle)
+    return -1;
+
+  queue_unlink(queue, handle);
+  return 0;
+}
+
+/*
+ * queue_enqueue_bulk - Enqueue several data items at once
+ * @queue: Queue in which to enqueue items
+ * @data: Array of the addresses of the data items to enqueue
+ * @count: Number of items in @data
+ *
+ * Return: -1 if @queue or @data are NULL, if @count is negative, if one of the
+ * items is NULL or in case of memory allocation error (nothing is enqueued
+ * then). 0 if all the items were enqueued in @queue.
+ */
+int queue_enqueue_bulk(queue_t queue, void **data, int count)
+{
+  if (!queue || !data || count < 0)
+    return -1;
+
+  // Build the whole chain aside first so that a failure leaves @queue as is
+  node *first = NULL;
+  node *last = NULL;
+  for (int i = 0; i < count; i++)
   {
-    node *current = previous->next; // current will go through the second oldest
-                                    // item to newest item
-    while (current)
-    { // while loop stops after the newest item
-      if (current->data == data)
-      {                // if the current item matches
-        tmp = current; // save the node so we can free it later
-        previous->next =
-            current->next; // connect previous node to current's next node ||
-                           // disconnect the link between the second newest item
-                           // to the newest item
-        if (current == queue->rear)
-        {                         // if this item happens to be the newest
-                                  // item on the queue
-          queue->rear = previous; // the second item becomes the newest item in
-                                  // the queue nn
-        }
-        else
-        {                       // if this item is anywhere in the queue but oldest or newest
-          current->next = NULL; // why not, doesnt hurt
-        }
-        free(tmp); // delete the found item from the queue
-        queue->size--;
-        current = previous; // since we deleted the current node, we need to
-                            // point current back to previous
-        found = 0;
+    node *new_node = data[i] ? queue_node_alloc(queue) : NULL;
+    if (!new_node)
+    {
+      while (first)
+      {
+        node *tmp = first->next;
+        queue_node_free(queue, first);
+        first = tmp;
       }
-      previous = current; // double linked list like setup to traverse the queue
-      current = current->next;
+      return -1;
     }
+    new_node->data = data[i];
+    new_node->prev = last;
+    new_node->next = NULL;
+    if (last)
+      last->next = new_node;
+    else
+      first = new_node;
+    last = new_node;
+  }
+  if (!first)
+    return 0;
+
+  first->prev = queue->rear;
+  if (queue->rear)
+    queue->rear->next = first;
+  else
+    queue->front = first;
+  queue->rear = last;
+  queue->size += count;
+  return 0;
+}
+
+/*
+ * queue_dequeue_bulk - Dequeue up to @count data items at once
+ * @queue: Queue in which to dequeue items
+ * @data: Array receiving the dequeued items, oldest first
+ * @count: Maximum number of items to dequeue
+ *
+ * Return: -1 if @queue or @data are NULL, or if @count is negative. Number of
+ * items stored in @data otherwise.
+ */
+int queue_dequeue_bulk(queue_t queue, void **data, int count)
+{
+  if (!queue || !data || count < 0)
+    return -1;
+
+  int i;
+  for (i = 0; i < count && queue->front; i++)
+  {
+    data[i] = queue->front->data;
+    queue_unlink(queue, queue->front);
   }
-  return found;
+  return i;
+}
+
+/*
+ * queue_splice - Move all the items of a queue at the end of another one
+ * @dst: Queue receiving the items
+ * @src: Queue giving its items, left empty
+ *
+ * Return: -1 if @dst or @src are NULL, or if they are the same queue. 0 if the
+ * items of @src were appended to @dst.
+ */
+int queue_splice(queue_t dst, queue_t src)
+{
+  if (!dst || !src || dst == src)
+    return -1;
+  if (!src->front)
+    return 0;
+
+  src->front->prev = dst->rear;
+  if (dst->rear)
+    dst->rear->next = src->front;
+  else
+    dst->front = src->front;
+  dst->rear = src->rear;
+  dst->size += src->size;
+
+  src->front = NULL;
+  src->rear = NULL;
+  src->size = 0;
+  return 0;
 }
 
 /*
@@ -8,10 +8,22 @@
  * other.  When dequeueing, the queue must returned the oldest enqueued item
  * first and so on.
  *
- * Apart from delete and iterate operations, all operations should be O(1).
+ * Apart from delete, iterate and bulk operations, all operations should be O(1).
+ * Items enqueued with queue_enqueue_handle() can also be removed in O(1) with
+ * queue_remove_handle().
  */
 typedef struct queue *queue_t;
 
+/*
+ * queue_handle_t - Queue item handle
+ *
+ * Opaque reference to one item of a queue, as returned by
+ * queue_enqueue_handle(). A handle stays valid only while its item is in the
+ * queue: once the item is dequeued, deleted or removed, the handle must not be
+ * used anymore.
+ */
+typedef struct queue_node *queue_handle_t;
+
 /*
  * queue_create - Allocate an empty queue
  *
@@ -45,6 +57,21 @@ int queue_destroy(queue_t queue);
  */
 int queue_enqueue(queue_t queue, void *data);
 
+/*
+ * queue_enqueue_handle - Enqueue data item and get a handle on it
+ * @queue: Queue in which to enqueue item
+ * @data: Address of data item to enqueue
+ * @handle: Address where to store the handle of the new item, or NULL
+ *
+ * Same as queue_enqueue(), but also return a handle that can later be given to
+ * queue_remove_handle() to take this very item out of the queue without
+ * searching for it (e.g. to cancel a thread waiting in a semaphore queue).
+ *
+ * Return: -1 if @queue or @data are NULL, or in case of memory allocation error
+ * when enqueing. 0 if @data was successfully enqueued in @queue.
+ */
+int queue_enqueue_handle(queue_t queue, void *data, queue_handle_t *handle);
+
 /*
  * queue_dequeue - Dequeue data item
  * @queue: Queue in which to dequeue item
@@ -71,6 +98,63 @@ int queue_dequeue(queue_t queue, void **data);
  */
 int queue_delete(queue_t queue, void *data);
 
+/*
+ * queue_remove_handle - Remove an item through its handle
+ * @queue: Queue in which the item is
+ * @handle: Handle of the item, as returned by queue_enqueue_handle()
+ *
+ * Remove the item referred to by @handle from queue @queue in O(1). The item
+ * must still be in @queue, otherwise the behavior is undefined.
+ *
+ * Return: -1 if @queue or @handle are NULL. 0 if the item was removed from
+ * @queue.
+ */
+int queue_remove_handle(queue_t queue, queue_handle_t handle);
+
+/*
+ * queue_enqueue_bulk - Enqueue several data items
+ * @queue: Queue in which to enqueue items
+ * @data: Array of the addresses of the data items to enqueue
+ * @count: Number of items in @data
+ *
+ * Enqueue the @count addresses of array @data in queue @queue, as if
+ * queue_enqueue() was called on each of them in order. Either all the items
+ * are enqueued or none is.
+ *
+ * Return: -1 if @queue or @data are NULL, if @count is negative, if one of the
+ * items is NULL, or in case of memory allocation error when enqueing. 0 if all
+ * the items were successfully enqueued in @queue.
+ */
+int queue_enqueue_bulk(queue_t queue, void **data, int count);
+
+/*
+ * queue_dequeue_bulk - Dequeue several data items
+ * @queue: Queue in which to dequeue items
+ * @data: Array where items are received
+ * @count: Maximum number of items to dequeue
+ *
+ * Remove the @count oldest items of queue @queue (or all of them if the queue
+ * has fewer items) and assign them to @data, oldest first.
+ *
+ * Return: -1 if @queue or @data are NULL, or if @count is negative. Number of
+ * items assigned to @data otherwise (0 if the queue is empty).
+ */
+int queue_dequeue_bulk(queue_t queue, void **data, int count);
+
+/*
+ * queue_splice - Concatenate two queues
+ * @dst: Queue at the end of which items are moved
+ * @src: Queue from which items are taken
+ *
+ * Move all the items of queue @src, in order, after the newest item of queue
+ * @dst. Queue @src is left empty. This operation is O(1) whatever the number
+ * of items, and the handles of the moved items stay valid (for @dst).
+ *
+ * Return: -1 if @dst or @src are NULL, or if they are the same queue. 0 if the
+ * items of @src were moved to @dst.
+ */
+int queue_splice(queue_t dst, queue_t src);
+
 /*
  * queue_func_t - Queue callback function type
  * @queue: Queue to which item belongs
@@ -0,0 +1,379 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/*
+ * Runtimes
+ *
+ * Each kernel thread in uthread_run() schedules its own green threads, from
+ * its own thread-local state, without any lock. Other kernel threads only
+ * reach it through a few fields of its runtime: tasks are pushed on a
+ * lock-free list (the inbox), and collected in bulk by the idle thread of the
+ * runtime, which turns them into green threads.
+ *
+ * When the idle thread runs out of work, it sleeps on an eventfd (the
+ * doorbell). Senders only ring the doorbell when the runtime sleeps: the
+ * runtime publishes that it sleeps before checking for work one last time,
+ * and senders publish their work before checking whether it sleeps, so at
+ * least one of them sees the other (both sides use sequentially consistent
+ * operations for that).
+ */
+
+struct runtime_msg
+{
+	uthread_func_t func;
+	void *arg;
+	struct runtime_msg *next;
+};
+
+/* Number of kernel threads in uthread_run() */
+static int nr_runtimes;
+
+/* Runtimes in uthread_run(), linked through their @next field */
+static struct uthread_runtime *runtimes;
+static int runtimes_lock;
+
+static void runtimes_lock_take(void)
+{
+	while (__atomic_exchange_n(&runtimes_lock, 1, __ATOMIC_ACQUIRE))
+	{
+		while (__atomic_load_n(&runtimes_lock, __ATOMIC_RELAXED))
+			cpu_relax();
+	}
+}
+
+static void runtimes_lock_drop(void)
+{
+	__atomic_store_n(&runtimes_lock, 0, __ATOMIC_RELEASE);
+}
+
+int runtime_start(void)
+{
+	uthread_rt.doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (uthread_rt.doorbell == -1)
+		return -1;
+	uthread_rt.inbox = NULL;
+	uthread_rt.wakeups = NULL;
+	uthread_rt.offload_done = NULL;
+	uthread_rt.nr_offloads = 0;
+	__atomic_store_n(&uthread_rt.sleeping, false, __ATOMIC_RELAXED);
+	__atomic_store_n(&uthread_rt.running, true, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&nr_runtimes, 1, __ATOMIC_RELAXED);
+
+	runtimes_lock_take();
+	uthread_rt.next = runtimes;
+	runtimes = &uthread_rt;
+	runtimes_lock_drop();
+	return 0;
+}
+
+void runtime_stop(void)
+{
+	struct uthread_runtime **link;
+
+	runtimes_lock_take();
+	for (link = &runtimes; *link != &uthread_rt; link = &(*link)->next)
+		;
+	*link = uthread_rt.next;
+	runtimes_lock_drop();
+
+	__atomic_store_n(&uthread_rt.running, false, __ATOMIC_RELEASE);
+	// Let the last kernel thread that gave us work finish ringing
+	while (__atomic_load_n(&uthread_rt.pins, __ATOMIC_ACQUIRE))
+		sched_yield();
+	close(uthread_rt.doorbell);
+	uthread_rt.doorbell = -1;
+	__atomic_sub_fetch(&nr_runtimes, 1, __ATOMIC_RELAXED);
+}
+
+void runtime_pin(struct uthread_runtime *rt)
+{
+	__atomic_add_fetch(&rt->pins, 1, __ATOMIC_SEQ_CST);
+}
+
+void runtime_unpin(struct uthread_runtime *rt)
+{
+	__atomic_sub_fetch(&rt->pins, 1, __ATOMIC_RELEASE);
+}
+
+int runtime_pin_others(struct uthread_runtime **rts, int max)
+{
+	struct uthread_runtime *rt;
+	int count = 0;
+
+	runtimes_lock_take();
+	for (rt = runtimes; rt && count < max; rt = rt->next)
+	{
+		if (rt == &uthread_rt)
+			continue;
+		runtime_pin(rt);
+		rts[count++] = rt;
+	}
+	runtimes_lock_drop();
+	return count;
+}
+
+void runtime_ring(struct uthread_runtime *rt)
+{
+	uint64_t one = 1;
+
+	// Pairs with the fence of runtime_wait()
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&rt->sleeping, __ATOMIC_SEQ_CST))
+		return;
+	while (write(rt->doorbell, &one, sizeof(one)) < 0 && errno == EINTR)
+		;
+}
+
+void runtime_poll(void)
+{
+	struct runtime_msg *msg, *fifo = NULL;
+
+	if (!__atomic_load_n(&uthread_rt.inbox, __ATOMIC_RELAXED))
+		return;
+
+	msg = __atomic_exchange_n(&uthread_rt.inbox, NULL, __ATOMIC_ACQUIRE);
+	while (msg)
+	{
+		struct runtime_msg *next = msg->next;
+
+		msg->next = fifo;
+		fifo = msg;
+		msg = next;
+	}
+
+	while (fifo)
+	{
+		msg = fifo;
+		fifo = msg->next;
+		uthread_create(msg->func, msg->arg);
+		free(msg);
+	}
+}
+
+/*
+ * Whether another kernel thread gave the runtime something to do, the last
+ * hold being dropped only counting if holds are all it waits for
+ */
+static bool runtime_has_work(bool holds_only)
+{
+	return __atomic_load_n(&uthread_rt.inbox, __ATOMIC_SEQ_CST) ||
+		   __atomic_load_n(&uthread_rt.wakeups, __ATOMIC_SEQ_CST) ||
+		   __atomic_load_n(&uthread_rt.offload_done, __ATOMIC_SEQ_CST) ||
+		   (holds_only &&
+			!__atomic_load_n(&uthread_rt.holds, __ATOMIC_SEQ_CST));
+}
+
+void runtime_wait(long long timeout_ns, bool holds_only)
+{
+	struct pollfd pfd = {.fd = uthread_rt.doorbell, .events = POLLIN};
+	struct timespec ts = {timeout_ns / 1000000000, timeout_ns % 1000000000};
+	uint64_t count;
+
+	__atomic_store_n(&uthread_rt.sleeping, true, __ATOMIC_SEQ_CST);
+	// Pairs with the fence of runtime_ring()
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	/*
+	 * The caller looks for what woke it up, and comes back if that was
+	 * nothing after all (a late ring, a signal)
+	 */
+	if (!runtime_has_work(holds_only) &&
+		ppoll(&pfd, 1, timeout_ns < 0 ? NULL : &ts, NULL) > 0)
+	{
+		if (read(uthread_rt.doorbell, &count, sizeof(count)) < 0)
+			count = 0;
+	}
+	__atomic_store_n(&uthread_rt.sleeping, false, __ATOMIC_RELAXED);
+}
+
+uthread_runtime_t uthread_runtime_self(void)
+{
+	if (!uthread_rt.running)
+		return NULL;
+	return &uthread_rt;
+}
+
+uthread_runtime_t uthread_runtime_hold(void)
+{
+	if (!uthread_rt.running)
+		return NULL;
+	__atomic_add_fetch(&uthread_rt.holds, 1, __ATOMIC_SEQ_CST);
+	return &uthread_rt;
+}
+
+void uthread_runtime_release(uthread_runtime_t rt)
+{
+	if (!rt)
+		return;
+	runtime_pin(rt);
+	__atomic_sub_fetch(&rt->holds, 1, __ATOMIC_SEQ_CST);
+	runtime_ring(rt);
+	runtime_unpin(rt);
+}
+
+int uthread_send(uthread_runtime_t rt, uthread_func_t func, void *arg)
+{
+	struct runtime_msg *msg;
+
+	if (!rt || !func)
+		return -1;
+
+	msg = malloc(sizeof(*msg));
+	if (!msg)
+		return -1;
+	msg->func = func;
+	msg->arg = arg;
+
+	runtime_pin(rt);
+	msg->next = __atomic_load_n(&rt->inbox, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&rt->inbox, &msg->next, msg, true,
+										__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		;
+	runtime_ring(rt);
+	runtime_unpin(rt);
+	return 0;
+}
+
+int uthread_nr_runtimes(void)
+{
+	return __atomic_load_n(&nr_runtimes, __ATOMIC_RELAXED);
+}
+
+/*
+ * Placement
+ *
+ * A pinned runtime stays on one CPU, and prefers the memory of the NUMA node
+ * of that CPU for everything it allocates while it runs. The memory policy is
+ * only a preference: allocations fall back on other nodes when the local one
+ * is full, and the policy is left alone where the kernel does not support it.
+ */
+
+/* Largest NUMA node number supported */
+#define RUNTIME_MAX_NODES 1024
+#define NODE_MASK_WORDS (RUNTIME_MAX_NODES / (8 * sizeof(unsigned long)))
+
+/* Affinity and memory policy of the kernel thread before it got pinned */
+static __thread cpu_set_t saved_affinity;
+static __thread bool saved_policy;
+static __thread int saved_mode;
+static __thread unsigned long saved_nodes[NODE_MASK_WORDS];
+
+/* NUMA node of @cpu, as listed by sysfs, 0 on kernels without NUMA */
+static int runtime_cpu_node(int cpu)
+{
+	char path[64];
+	struct dirent *d;
+	DIR *dir;
+	int node = 0;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	dir = opendir(path);
+	if (!dir)
+		return 0;
+	while ((d = readdir(dir)))
+	{
+		if (sscanf(d->d_name, "node%d", &node) == 1)
+			break;
+	}
+	closedir(dir);
+	return node < RUNTIME_MAX_NODES ? node : 0;
+}
+
+static void runtime_prefer_node(int node)
+{
+	unsigned long nodes[NODE_MASK_WORDS] = {0};
+	const unsigned long bits = 8 * sizeof(unsigned long);
+
+	// The kernel counts one node more than the mask holds
+	saved_policy = syscall(SYS_get_mempolicy, &saved_mode, saved_nodes,
+						   RUNTIME_MAX_NODES + 1, NULL, 0) == 0;
+	if (!saved_policy)
+		return;
+	nodes[node / bits] = 1UL << (node % bits);
+	if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodes,
+				RUNTIME_MAX_NODES + 1))
+		saved_policy = false;
+}
+
+static int runtime_bind(int cpu)
+{
+	cpu_set_t set;
+
+	if (cpu < 0 || cpu >= CPU_SETSIZE)
+		return -1;
+	if (sched_getaffinity(0, sizeof(saved_affinity), &saved_affinity))
+		return -1;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		return -1;
+
+	uthread_rt.cpu = cpu;
+	uthread_rt.node = runtime_cpu_node(cpu);
+	uthread_rt.pinned = true;
+	runtime_prefer_node(uthread_rt.node);
+	return 0;
+}
+
+static void runtime_unbind(void)
+{
+	if (saved_policy)
+		syscall(SYS_set_mempolicy, saved_mode,
+				saved_mode == MPOL_DEFAULT ? NULL : saved_nodes,
+				RUNTIME_MAX_NODES + 1);
+	saved_policy = false;
+	sched_setaffinity(0, sizeof(saved_affinity), &saved_affinity);
+	uthread_rt.pinned = false;
+}
+
+int uthread_runtime_attr_init(uthread_runtime_attr_t *attr)
+{
+	if (!attr)
+		return -1;
+	attr->cpu = -1;
+	return 0;
+}
+
+int uthread_run_attr(bool preempt, uthread_func_t func, void *arg,
+					 const uthread_runtime_attr_t *attr)
+{
+	int ret;
+
+	if (!attr || attr->cpu == -1)
+		return uthread_run(preempt, func, arg);
+
+	// Also checked by uthread_run(), but pinning would already be undone
+	if (uthread_rt.running || runtime_bind(attr->cpu))
+		return -1;
+	ret = uthread_run(preempt, func, arg);
+	runtime_unbind();
+	return ret;
+}
+
+int uthread_runtime_cpu(uthread_runtime_t rt)
+{
+	if (!rt || !__atomic_load_n(&rt->pinned, __ATOMIC_RELAXED))
+		return -1;
+	return rt->cpu;
+}
+
+int uthread_runtime_node(uthread_runtime_t rt)
+{
+	if (!rt || !__atomic_load_n(&rt->pinned, __ATOMIC_RELAXED))
+		return -1;
+	return rt->node;
+}
@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
 
@@ -6,16 +7,47 @@
 #include "sem.h"
 #include "private.h"
 
-extern bool to_preempt;
-
 typedef unsigned long long usize;
 
+/*
+ * Semaphores may be shared by threads of several runtimes, so their state is
+ * protected by a spinlock, only ever held for a few instructions.
+ *
+ * With several runtimes, the holder of an unavailable semaphore may be running
+ * on another CPU, about to release it: sem_down() then spins a little before
+ * parking the thread, which is much cheaper than blocking and getting woken up
+ * by another runtime when the wait is short. How long to spin is learned per
+ * semaphore: the budget doubles when spinning got the semaphore, and halves
+ * when it did not.
+ */
+#define SEM_SPIN_MIN 16
+#define SEM_SPIN_MAX 4096
+
 typedef struct semaphore
 {
+	int lock;
+	int spin;
 	usize sem_count;
 	queue_t sem_queue;
 } semaphore;
 
+static void sem_lock(sem_t sem)
+{
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	while (__atomic_exchange_n(&sem->lock, 1, __ATOMIC_ACQUIRE))
+	{
+		while (__atomic_load_n(&sem->lock, __ATOMIC_RELAXED))
+			cpu_relax();
+	}
+}
+
+static void sem_unlock(sem_t sem)
+{
+	__atomic_store_n(&sem->lock, 0, __ATOMIC_RELEASE);
+	preempt_enable();
+}
+
 sem_t sem_create(size_t count)
 {
 
@@ -23,9 +55,11 @@ sem_t sem_create(size_t count)
 	if (!new_sem)
 		return NULL;
 
-	if (to_preempt)
+	if (uthread_rt.to_preempt)
 		preempt_disable();
 
+	new_sem->lock = 0;
+	new_sem->spin = SEM_SPIN_MIN;
 	new_sem->sem_count = count;
 	new_sem->sem_queue = queue_create();
 
@@ -45,61 +79,144 @@ int sem_destroy(sem_t sem)
 	if (!sem)
 		return -1;
 
-	if (to_preempt)
-		preempt_disable();
-
+	sem_lock(sem);
 	if (queue_length(sem->sem_queue) > 0)
+	{
+		sem_unlock(sem);
 		return -1;
+	}
+	sem_unlock(sem);
 
-	preempt_enable();
 	queue_destroy(sem->sem_queue);
 	free(sem);
 
 	return 0;
 }
 
-int sem_down(sem_t sem)
+int sem_down_async(sem_t sem, struct sem_waiter *waiter)
 {
-	if (!sem)
+	if (!sem || !waiter)
 		return -1;
 
+	sem_lock(sem);
 	if (sem->sem_count == 0)
 	{
-		if (to_preempt)
-			preempt_disable();
-
-		struct uthread_tcb *curr_thd = uthread_current();
-		queue_enqueue(sem->sem_queue, curr_thd);
-		preempt_enable();
+		if (queue_enqueue_handle(sem->sem_queue, waiter, &waiter->node))
+		{
+			sem_unlock(sem);
+			return -1;
+		}
+		uthread_rt.stats.sem_contended++;
+		TRACE(TRACE_SEM_WAIT, uthread_self(), (uintptr_t)sem);
+		sem_unlock(sem);
 
-		uthread_block();
-		return 0;
+		return 1;
 	}
 
 	sem->sem_count--;
+	sem_unlock(sem);
 	return 0;
 }
 
+/* Wait for another runtime to release @sem, for a learned number of rounds */
+static bool sem_spin(sem_t sem)
+{
+	int budget = __atomic_load_n(&sem->spin, __ATOMIC_RELAXED);
+
+	for (int i = 0; i < budget; i++)
+	{
+		if (__atomic_load_n(&sem->sem_count, __ATOMIC_RELAXED))
+		{
+			bool taken = false;
+
+			sem_lock(sem);
+			if (sem->sem_count)
+			{
+				sem->sem_count--;
+				taken = true;
+			}
+			sem_unlock(sem);
+			if (taken)
+			{
+				// Not worth learning from when there was no wait at all
+				if (i && budget < SEM_SPIN_MAX)
+					__atomic_store_n(&sem->spin, 2 * budget, __ATOMIC_RELAXED);
+				if (i)
+					uthread_rt.stats.sem_spun++;
+				return true;
+			}
+		}
+		cpu_relax();
+	}
+
+	if (budget > SEM_SPIN_MIN)
+		__atomic_store_n(&sem->spin, budget / 2, __ATOMIC_RELAXED);
+	return false;
+}
+
+int sem_down(sem_t sem)
+{
+	int ret;
+
+	if (!sem || uthread_cancel_pending())
+		return -1;
+
+	// Nobody can release the semaphore while this runtime spins alone
+	if (uthread_nr_runtimes() > 1 && sem_spin(sem))
+		ret = 0;
+	else
+		ret = sem_down_async(sem, uthread_waiter());
+
+	if (ret == 1)
+	{
+		// Another runtime may release it, this one must not end meanwhile
+		uthread_runtime_t rt = uthread_nr_runtimes() > 1 ?
+								   uthread_runtime_hold() : NULL;
+
+		ret = uthread_block_sem(sem);
+		uthread_runtime_release(rt);
+		return ret;
+	}
+	if (ret == 0)
+		uthread_consume_budget();
+	return ret;
+}
+
+int sem_cancel_wait(sem_t sem, struct sem_waiter *waiter)
+{
+	int ret;
+
+	sem_lock(sem);
+	// Dequeued already if the semaphore was handed over to it
+	ret = queue_remove_handle(sem->sem_queue, waiter->node);
+	waiter->node = NULL;
+	sem_unlock(sem);
+	return ret;
+}
+
 int sem_up(sem_t sem)
 {
 	if (!sem)
 		return -1;
 
+	sem_lock(sem);
 	if (queue_length(sem->sem_queue) > 0)
 	{
-		if (to_preempt)
-			preempt_disable();
-
-		struct uthread_tcb *first_ready = NULL;
-		if (queue_dequeue(sem->sem_queue, (void **)&first_ready) == -1)
+		struct sem_waiter *first_waiter = NULL;
+		if (queue_dequeue(sem->sem_queue, (void **)&first_waiter) == -1)
+		{
+			sem_unlock(sem);
 			return -1;
+		}
+		first_waiter->node = NULL;
+		TRACE(TRACE_SEM_WAKE, uthread_self(), (uintptr_t)sem);
+		sem_unlock(sem);
 
-		preempt_enable();
-
-		uthread_unblock(first_ready);
+		first_waiter->wake(first_waiter);
 		return 0;
 	}
 
 	sem->sem_count++;
+	sem_unlock(sem);
 	return 0;
 }
\ No newline at end of file
@@ -12,9 +12,33 @@
  * shared a certain number of times. When a thread successfully takes the
  * resource, the count is decreased. When the resource is not available,
  * following threads are blocked until the resource becomes available again.
+ *
+ * Semaphores can be shared by the threads of several runtimes (see
+ * uthread_run()). While other runtimes are running, a runtime whose threads
+ * are blocked on a semaphore does not return from uthread_run(), as another
+ * runtime may release it. A runtime alone expects nobody else to release its
+ * semaphores, so runtimes sharing semaphores should all be running before
+ * their threads block on them.
  */
 typedef struct semaphore *sem_t;
 
+/*
+ * struct sem_waiter - Waiter on a semaphore
+ * @wake: Function called when the semaphore is handed over to the waiter
+ * @data: Free for the owner of the waiter to use
+ * @node: Used by the semaphore while the waiter is queued
+ *
+ * Threads waiting in sem_down() are represented by such waiters too, but
+ * waiters are also the way for code that cannot block a thread (e.g.
+ * coroutines) to wait on a semaphore, with sem_down_async().
+ */
+struct sem_waiter
+{
+	void (*wake)(struct sem_waiter *waiter);
+	void *data;
+	struct queue_node *node;
+};
+
 /*
  * sem_create - Create semaphore
  * @count: Semaphore count
@@ -44,12 +68,39 @@ int sem_destroy(sem_t sem);
  * Take a resource from semaphore @sem.
  *
  * Taking an unavailable semaphore will cause the caller thread to be blocked
- * until the semaphore becomes available.
+ * until the semaphore becomes available. When other runtimes are running, the
+ * caller first spins for a while, in case one of them releases the semaphore
+ * shortly: how long is adjusted for each semaphore, depending on whether
+ * spinning paid off the previous times. Taking an available one spends a unit
+ * of the yield budget of the caller (see uthread_consume_budget()).
+ *
+ * This is a cancellation point (see uthread_cancel()).
  *
- * Return: -1 if @sem is NULL. 0 if semaphore was successfully taken.
+ * Return: -1 if @sem is NULL, in case of memory allocation failure when
+ * queuing the calling thread, or with errno set to ECANCELED if it was
+ * cancelled before or while waiting. 0 if semaphore was successfully taken.
  */
 int sem_down(sem_t sem);
 
+/*
+ * sem_down_async - Take a semaphore, or wait for it without blocking
+ * @sem: Semaphore to take
+ * @waiter: Waiter to queue if the semaphore is unavailable
+ *
+ * If semaphore @sem is unavailable, queue @waiter, which must stay valid until
+ * its @wake function is called: when a resource is released, it is handed
+ * over to @waiter directly, as it would to a thread blocked in sem_down().
+ * @wake is called from the thread releasing the resource, and must not block.
+ * As that thread may belong to another runtime, waiters other than threads
+ * blocked in sem_down() may only wait on semaphores not shared with other
+ * runtimes.
+ *
+ * Return: -1 if @sem or @waiter is NULL, or in case of memory allocation
+ * failure when queuing @waiter. 0 if semaphore was successfully taken, 1 if
+ * @waiter was queued.
+ */
+int sem_down_async(sem_t sem, struct sem_waiter *waiter);
+
 /*
  * sem_up - Release a semaphore
  * @sem: Semaphore to release
@@ -58,7 +109,7 @@ int sem_down(sem_t sem);
  *
  * If the waiting list associated to @sem is not empty, releasing a resource
  * also causes the first thread (i.e. the oldest) in the waiting list to be
- * unblocked.
+ * unblocked, or the first waiter to be woken up.
  *
  * Return: -1 if @sem is NULL. 0 if semaphore was successfully released.
  */
@@ -0,0 +1,194 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/* Stack usage of each thread function seen so far, in order of first exit */
+static __thread struct uthread_stack_usage *usages;
+static __thread int nr_usages;
+static __thread int usages_cap;
+
+static int stack_usage_bucket(size_t used)
+{
+	int b = 0;
+
+	while (b < UTHREAD_STACK_USAGE_BUCKETS - 1 && used >= (1024UL << b))
+		b++;
+	return b;
+}
+
+static struct uthread_stack_usage *stack_usage_find(uthread_func_t func)
+{
+	for (int i = 0; i < nr_usages; i++)
+		if (usages[i].func == func)
+			return &usages[i];
+
+	if (nr_usages == usages_cap)
+	{
+		int cap = usages_cap ? 2 * usages_cap : 16;
+		struct uthread_stack_usage *new_usages =
+			realloc(usages, cap * sizeof(*usages));
+
+		if (!new_usages)
+			return NULL;
+		usages = new_usages;
+		usages_cap = cap;
+	}
+	memset(&usages[nr_usages], 0, sizeof(*usages));
+	usages[nr_usages].func = func;
+	return &usages[nr_usages++];
+}
+
+void stack_usage_record(uthread_func_t func, size_t stack_size, size_t used)
+{
+	struct uthread_stack_usage *u = stack_usage_find(func);
+
+	// Losing a measure is better than failing the thread's exit
+	if (!u)
+		return;
+
+	u->nr_threads++;
+	if (stack_size > u->max_stack_size)
+		u->max_stack_size = stack_size;
+	if (used > u->max_used)
+		u->max_used = used;
+	u->hist[stack_usage_bucket(used)]++;
+}
+
+int uthread_stack_usage(struct uthread_stack_usage *usage, int len)
+{
+	int n;
+
+	if (!usage || len < 0)
+		return -1;
+
+	n = nr_usages < len ? nr_usages : len;
+	memcpy(usage, usages, n * sizeof(*usages));
+	return n;
+}
+
+void uthread_stack_usage_reset(void)
+{
+	free(usages);
+	usages = NULL;
+	nr_usages = 0;
+	usages_cap = 0;
+}
+
+/*
+ * Stack overflow detection
+ *
+ * The fault of an overflow happens with the stack pointer in the guard page,
+ * so the handler needs its own stack to run at all. The handler is set for the
+ * whole process, but each kernel thread needs an alternate stack of its own,
+ * which replaces that of the application until uthread_run() returns.
+ * Faults that are not overflows go to the disposition the process had before.
+ */
+static pthread_mutex_t guard_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool guard_installed;
+static struct sigaction guard_old_act;
+static __thread bool guard_stack_installed;
+static __thread void *guard_stack;
+static __thread stack_t guard_old_stack;
+
+static void stack_guard_report(int tid)
+{
+	char msg[64] = "uthread: stack overflow in thread ";
+	size_t len = strlen(msg);
+	char digits[16];
+	int n = 0;
+
+	// Only async-signal-safe functions from here
+	do
+	{
+		digits[n++] = '0' + tid % 10;
+		tid /= 10;
+	} while (tid);
+	while (n)
+		msg[len++] = digits[--n];
+	msg[len++] = '\n';
+	if (write(STDERR_FILENO, msg, len) < 0)
+		return;
+}
+
+static void stack_guard_handler(int signo, siginfo_t *info, void *ucontext)
+{
+	int tid = uthread_stack_overflowed(info->si_addr);
+
+	if (tid != -1)
+	{
+		stack_guard_report(tid);
+		/*
+		 * Not ours to recover from: returning with the default action
+		 * restored faults again, and kills the process as if we had never
+		 * been there
+		 */
+		signal(signo, SIG_DFL);
+		return;
+	}
+
+	if (guard_old_act.sa_flags & SA_SIGINFO)
+		guard_old_act.sa_sigaction(signo, info, ucontext);
+	else if (guard_old_act.sa_handler != SIG_DFL &&
+			 guard_old_act.sa_handler != SIG_IGN)
+		guard_old_act.sa_handler(signo);
+	else
+		// Faults again once returning, with the previous disposition back
+		sigaction(signo, &guard_old_act, NULL);
+}
+
+int stack_guard_install(void)
+{
+	struct sigaction act;
+	stack_t ss;
+	int ret = 0;
+
+	if (!guard_stack_installed)
+	{
+		ss.ss_sp = malloc(SIGSTKSZ);
+		if (!ss.ss_sp)
+			return -1;
+		ss.ss_size = SIGSTKSZ;
+		ss.ss_flags = 0;
+		if (sigaltstack(&ss, &guard_old_stack))
+		{
+			free(ss.ss_sp);
+			return -1;
+		}
+		guard_stack = ss.ss_sp;
+		guard_stack_installed = true;
+	}
+
+	if (__atomic_load_n(&guard_installed, __ATOMIC_ACQUIRE))
+		return 0;
+
+	pthread_mutex_lock(&guard_lock);
+	if (!guard_installed)
+	{
+		memset(&act, 0, sizeof(act));
+		act.sa_sigaction = stack_guard_handler;
+		act.sa_flags = SA_SIGINFO | SA_ONSTACK;
+		sigemptyset(&act.sa_mask);
+		if (sigaction(SIGSEGV, &act, &guard_old_act))
+			ret = -1;
+		else
+			__atomic_store_n(&guard_installed, true, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&guard_lock);
+	return ret;
+}
+
+void stack_guard_reset(void)
+{
+	if (!guard_stack_installed)
+		return;
+	sigaltstack(&guard_old_stack, NULL);
+	free(guard_stack);
+	guard_stack = NULL;
+	guard_stack_installed = false;
+}
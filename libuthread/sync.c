@@ -0,0 +1,257 @@
+#include <stdlib.h>
+
+#include "private.h"
+#include "queue.h"
+#include "sync.h"
+#include "uthread.h"
+
+struct waitgroup
+{
+	int count;
+	queue_t waiters;
+};
+
+struct barrier
+{
+	unsigned int count;
+	/* Threads of the current round blocked until the last one arrives */
+	queue_t waiters;
+};
+
+struct latch
+{
+	unsigned int count;
+	queue_t waiters;
+};
+
+enum
+{
+	ONCE_PENDING,
+	ONCE_RUNNING,
+	ONCE_DONE,
+};
+
+/*
+ * sync_block - Block the running thread on a queue of waiters
+ * @waiters: Queue to wait in, until uthread_unblock_all() is called on it
+ *
+ * Called with preemption disabled, which it enables back.
+ *
+ * Return: -1 if not called from a thread, or in case of failure when queuing
+ * it. 0 once woken up.
+ */
+static int sync_block(queue_t waiters)
+{
+	if (uthread_self() == -1 ||
+		queue_enqueue(waiters, uthread_current()) == -1)
+	{
+		preempt_enable();
+		return -1;
+	}
+	preempt_enable();
+	uthread_block();
+	return 0;
+}
+
+waitgroup_t waitgroup_create(void)
+{
+	struct waitgroup *wg = malloc(sizeof(*wg));
+
+	if (!wg)
+		return NULL;
+	wg->waiters = queue_create();
+	if (!wg->waiters)
+	{
+		free(wg);
+		return NULL;
+	}
+	wg->count = 0;
+	return wg;
+}
+
+int waitgroup_destroy(waitgroup_t wg)
+{
+	if (!wg || queue_length(wg->waiters))
+		return -1;
+
+	queue_destroy(wg->waiters);
+	free(wg);
+	return 0;
+}
+
+int waitgroup_add(waitgroup_t wg, int delta)
+{
+	if (!wg || wg->count + delta < 0)
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	wg->count += delta;
+	if (!wg->count)
+		uthread_unblock_all(wg->waiters);
+	preempt_enable();
+	return 0;
+}
+
+int waitgroup_done(waitgroup_t wg)
+{
+	return waitgroup_add(wg, -1);
+}
+
+int waitgroup_wait(waitgroup_t wg)
+{
+	if (!wg || uthread_cancel_pending())
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	if (!wg->count)
+	{
+		preempt_enable();
+		return 0;
+	}
+	return sync_block(wg->waiters);
+}
+
+barrier_t barrier_create(unsigned int count)
+{
+	struct barrier *barrier;
+
+	if (!count)
+		return NULL;
+
+	barrier = malloc(sizeof(*barrier));
+	if (!barrier)
+		return NULL;
+	barrier->waiters = queue_create();
+	if (!barrier->waiters)
+	{
+		free(barrier);
+		return NULL;
+	}
+	barrier->count = count;
+	return barrier;
+}
+
+int barrier_destroy(barrier_t barrier)
+{
+	if (!barrier || queue_length(barrier->waiters))
+		return -1;
+
+	queue_destroy(barrier->waiters);
+	free(barrier);
+	return 0;
+}
+
+int barrier_wait(barrier_t barrier)
+{
+	if (!barrier || uthread_cancel_pending())
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	if ((unsigned int)queue_length(barrier->waiters) + 1 == barrier->count)
+	{
+		// Woken up threads do not check again, the next round can start now
+		uthread_unblock_all(barrier->waiters);
+		preempt_enable();
+		return 1;
+	}
+	return sync_block(barrier->waiters);
+}
+
+latch_t latch_create(unsigned int count)
+{
+	struct latch *latch = malloc(sizeof(*latch));
+
+	if (!latch)
+		return NULL;
+	latch->waiters = queue_create();
+	if (!latch->waiters)
+	{
+		free(latch);
+		return NULL;
+	}
+	latch->count = count;
+	return latch;
+}
+
+int latch_destroy(latch_t latch)
+{
+	if (!latch || queue_length(latch->waiters))
+		return -1;
+
+	queue_destroy(latch->waiters);
+	free(latch);
+	return 0;
+}
+
+int latch_count_down(latch_t latch)
+{
+	if (!latch || !latch->count)
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	if (!--latch->count)
+		uthread_unblock_all(latch->waiters);
+	preempt_enable();
+	return 0;
+}
+
+int latch_wait(latch_t latch)
+{
+	if (!latch || uthread_cancel_pending())
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	if (!latch->count)
+	{
+		preempt_enable();
+		return 0;
+	}
+	return sync_block(latch->waiters);
+}
+
+int once(once_t *once, void (*func)(void))
+{
+	if (!once || !func)
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	if (once->state == ONCE_DONE)
+	{
+		preempt_enable();
+		return 0;
+	}
+	if (once->state == ONCE_RUNNING)
+	{
+		// Only allocated if somebody has to wait, freed by the runner
+		if (!once->waiters)
+			once->waiters = queue_create();
+		if (!once->waiters)
+		{
+			preempt_enable();
+			return -1;
+		}
+		return sync_block(once->waiters);
+	}
+
+	once->state = ONCE_RUNNING;
+	preempt_enable();
+	func();
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	once->state = ONCE_DONE;
+	if (once->waiters)
+	{
+		uthread_unblock_all(once->waiters);
+		queue_destroy(once->waiters);
+		once->waiters = NULL;
+	}
+	preempt_enable();
+	return 0;
+}
@@ -0,0 +1,190 @@
+#ifndef _SYNC_H
+#define _SYNC_H
+
+#include <stdbool.h>
+
+#include "queue.h"
+
+/*
+ * Wait groups, barriers, latches and once-initialization
+ *
+ * These primitives block threads until some condition holds for all of them
+ * at once, at which point all their waiters are moved to the ready queue in
+ * one go, instead of being woken up one by one as with semaphores.
+ *
+ * Unlike semaphores, they belong to the runtime they are first used in (see
+ * uthread_run()), and only the threads of that runtime may wait on them.
+ * Waiting on them is a cancellation point on entry only: a thread cancelled
+ * while blocked stays blocked until the condition holds.
+ */
+
+/*
+ * waitgroup_t - Wait group type
+ *
+ * A wait group counts outstanding pieces of work: waitgroup_add() accounts for
+ * new ones, waitgroup_done() for completed ones, and waitgroup_wait() blocks
+ * until there are none left.
+ */
+typedef struct waitgroup *waitgroup_t;
+
+/*
+ * waitgroup_create - Create a wait group
+ *
+ * Return: New wait group, with a count of 0, or NULL in case of failure when
+ * allocating it
+ */
+waitgroup_t waitgroup_create(void);
+
+/*
+ * waitgroup_destroy - Deallocate a wait group
+ * @wg: Wait group to deallocate
+ *
+ * Return: -1 if @wg is NULL or if threads are waiting on it. 0 otherwise.
+ */
+int waitgroup_destroy(waitgroup_t wg);
+
+/*
+ * waitgroup_add - Change the count of a wait group
+ * @wg: Wait group to change
+ * @delta: Number of pieces of work to add, or to remove if negative
+ *
+ * All the waiters of @wg are woken up if its count drops to 0.
+ *
+ * Return: -1 if @wg is NULL or if its count would become negative. 0 otherwise.
+ */
+int waitgroup_add(waitgroup_t wg, int delta);
+
+/*
+ * waitgroup_done - Account for a completed piece of work
+ * @wg: Wait group to change
+ *
+ * Same as waitgroup_add() with a @delta of -1.
+ *
+ * Return: -1 if @wg is NULL or if its count is 0 already. 0 otherwise.
+ */
+int waitgroup_done(waitgroup_t wg);
+
+/*
+ * waitgroup_wait - Wait for the count of a wait group to drop to 0
+ * @wg: Wait group to wait on
+ *
+ * Return: -1 if @wg is NULL, if the count is not 0 and the caller is not a
+ * thread, or if the calling thread was cancelled (with errno set to
+ * ECANCELED). 0 otherwise.
+ */
+int waitgroup_wait(waitgroup_t wg);
+
+/*
+ * barrier_t - Barrier type
+ *
+ * A barrier holds the threads reaching it until a given number of them did,
+ * then lets them all through at once. It is then ready for the next round.
+ */
+typedef struct barrier *barrier_t;
+
+/*
+ * barrier_create - Create a barrier
+ * @count: Number of threads to wait for at each round
+ *
+ * Return: New barrier, or NULL if @count is 0 or in case of failure when
+ * allocating it
+ */
+barrier_t barrier_create(unsigned int count);
+
+/*
+ * barrier_destroy - Deallocate a barrier
+ * @barrier: Barrier to deallocate
+ *
+ * Return: -1 if @barrier is NULL or if threads are waiting on it. 0 otherwise.
+ */
+int barrier_destroy(barrier_t barrier);
+
+/*
+ * barrier_wait - Wait for the other threads of a round to reach a barrier
+ * @barrier: Barrier to wait on
+ *
+ * Block until @count threads called barrier_wait() in the current round. The
+ * last one to arrive does not block, and wakes all the others up.
+ *
+ * Return: -1 if @barrier is NULL, if the caller would block without being a
+ * thread, or if the calling thread was cancelled (with errno set to
+ * ECANCELED), in which case it does not count as arrived. 1 for the last
+ * thread of the round to arrive. 0 for the others.
+ */
+int barrier_wait(barrier_t barrier);
+
+/*
+ * latch_t - Countdown latch type
+ *
+ * A latch starts closed with a count, and opens for good once counted down to
+ * 0, letting all its waiters through at once.
+ */
+typedef struct latch *latch_t;
+
+/*
+ * latch_create - Create a countdown latch
+ * @count: Number of times to count the latch down before it opens, a latch
+ *	created with a count of 0 being open from the start
+ *
+ * Return: New latch, or NULL in case of failure when allocating it
+ */
+latch_t latch_create(unsigned int count);
+
+/*
+ * latch_destroy - Deallocate a countdown latch
+ * @latch: Latch to deallocate
+ *
+ * Return: -1 if @latch is NULL or if threads are waiting on it. 0 otherwise.
+ */
+int latch_destroy(latch_t latch);
+
+/*
+ * latch_count_down - Count a latch down
+ * @latch: Latch to count down
+ *
+ * All the waiters of @latch are woken up if its count drops to 0.
+ *
+ * Return: -1 if @latch is NULL or open already. 0 otherwise.
+ */
+int latch_count_down(latch_t latch);
+
+/*
+ * latch_wait - Wait for a latch to open
+ * @latch: Latch to wait on
+ *
+ * Return: -1 if @latch is NULL, if it is closed and the caller is not a
+ * thread, or if the calling thread was cancelled (with errno set to
+ * ECANCELED). 0 otherwise.
+ */
+int latch_wait(latch_t latch);
+
+/*
+ * once_t - Once-initialization control type
+ *
+ * To be statically initialized with ONCE_INIT, and passed to once().
+ */
+typedef struct
+{
+	int state;
+	queue_t waiters;
+} once_t;
+
+#define ONCE_INIT {0, NULL}
+
+/*
+ * once - Run an initialization function exactly once
+ * @once: Control of the initialization
+ * @func: Initialization function
+ *
+ * The first call with @once runs @func. Threads calling once() while @func
+ * runs, e.g. because it blocked, wait for it to complete, and are all woken up
+ * together when it does. Later calls return right away. @func must not call
+ * once() on @once itself.
+ *
+ * Return: -1 if @once or @func is NULL, if @func is running and the caller is
+ * not a thread, or in case of failure when allocating the queue of waiters. 0
+ * once @func completed.
+ */
+int once(once_t *once, void (*func)(void));
+
+#endif /* _SYNC_H */
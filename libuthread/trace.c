@@ -0,0 +1,214 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "private.h"
+#include "uthread.h"
+
+/*
+ * Trace events are appended to a ring buffer owned by the runtime, which is
+ * its only writer: recording an event is a timestamp read and a few stores,
+ * with no lock. Once the ring is full, the oldest events are overwritten so
+ * that a capture always holds the latest activity.
+ *
+ * Timestamps are raw TSC values where available, converted to nanoseconds
+ * only when dumping, using the TSC rate measured over the capture.
+ */
+struct trace_event
+{
+	uint64_t ts;
+	uint64_t arg;
+	int32_t type;
+	int32_t tid;
+};
+
+__thread bool uthread_trace_on;
+
+static __thread struct trace_event *ring;
+static __thread size_t ring_size;
+static __thread uint64_t ring_head; // Number of events ever recorded
+static __thread uint64_t start_ts;
+static __thread unsigned long long start_ns;
+static __thread uint64_t stop_ts;
+static __thread unsigned long long stop_ns;
+static __thread int idle_tid = -1; // Idle thread of the last uthread_run()
+
+static inline uint64_t trace_ts(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return uthread_clock_ns();
+#endif
+}
+
+void trace_record(trace_type_t type, int tid, uint64_t arg)
+{
+	struct trace_event *e = &ring[ring_head++ % ring_size];
+
+	e->ts = trace_ts();
+	e->arg = arg;
+	e->type = type;
+	e->tid = tid;
+}
+
+void trace_idle(int tid)
+{
+	idle_tid = tid;
+}
+
+int uthread_trace_start(size_t nr_events)
+{
+	if (!nr_events)
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	struct trace_event *new_ring = realloc(ring, nr_events * sizeof(*ring));
+	if (!new_ring)
+	{
+		preempt_enable();
+		return -1;
+	}
+	ring = new_ring;
+	ring_size = nr_events;
+	ring_head = 0;
+	start_ns = uthread_clock_ns();
+	start_ts = trace_ts();
+	uthread_trace_on = true;
+	preempt_enable();
+
+	return 0;
+}
+
+void uthread_trace_stop(void)
+{
+	if (!uthread_trace_on)
+		return;
+	uthread_trace_on = false;
+	stop_ts = trace_ts();
+	stop_ns = uthread_clock_ns();
+}
+
+/*
+ * trace_name_thread - Emit the track name of @tid the first time it shows up
+ */
+static int trace_name_thread(FILE *f, int pid, int tid, uint8_t **seen,
+							 size_t *nr_seen)
+{
+	if (tid < 0)
+		return 0;
+	if ((size_t)tid >= *nr_seen * 8)
+	{
+		size_t n = (tid / 8 + 1) * 2;
+		uint8_t *tmp = realloc(*seen, n);
+		if (!tmp)
+			return -1;
+		memset(tmp + *nr_seen, 0, n - *nr_seen);
+		*seen = tmp;
+		*nr_seen = n;
+	}
+	if ((*seen)[tid / 8] & (1 << (tid % 8)))
+		return 0;
+	(*seen)[tid / 8] |= 1 << (tid % 8);
+
+	if (tid == idle_tid)
+		fprintf(f, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,"
+				   "\"tid\":%d,\"args\":{\"name\":\"idle\"}}",
+				pid, tid);
+	else
+		fprintf(f, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,"
+				   "\"tid\":%d,\"args\":{\"name\":\"uthread %d\"}}",
+				pid, tid, tid);
+	return 0;
+}
+
+static const char *trace_names[] = {
+	[TRACE_SWITCH] = "switch",
+	[TRACE_CREATE] = "create",
+	[TRACE_EXIT] = "exit",
+	[TRACE_BLOCK] = "block",
+	[TRACE_UNBLOCK] = "unblock",
+	[TRACE_SEM_WAIT] = "sem_wait",
+	[TRACE_SEM_WAKE] = "sem_wake",
+};
+
+int uthread_trace_dump(const char *path)
+{
+	if (!path || !ring)
+		return -1;
+
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+
+	// Measure how fast timestamps go, over the whole capture
+	uint64_t end_ts = uthread_trace_on ? trace_ts() : stop_ts;
+	unsigned long long end_ns = uthread_trace_on ? uthread_clock_ns() : stop_ns;
+	double ns_per_tick = 1;
+	if (end_ts > start_ts && end_ns > start_ns)
+		ns_per_tick = (double)(end_ns - start_ns) / (end_ts - start_ts);
+#define TS_US(ts) (((ts) - start_ts) * ns_per_tick / 1000)
+
+	int pid = getpid();
+	uint8_t *seen = NULL;
+	size_t nr_seen = 0;
+	uint64_t first = ring_head > ring_size ? ring_head - ring_size : 0;
+	int running = -1;
+	uint64_t running_since = 0;
+	int ret = 0;
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+			   "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,"
+			   "\"args\":{\"name\":\"libuthread\"}}",
+			pid);
+
+	for (uint64_t i = first; i < ring_head && !ret; i++)
+	{
+		struct trace_event *e = &ring[i % ring_size];
+
+		ret = trace_name_thread(f, pid, e->tid, &seen, &nr_seen);
+		if (e->type != TRACE_SWITCH)
+		{
+			fprintf(f, ",\n{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\","
+					   "\"pid\":%d,\"tid\":%d,\"ts\":%.3f,"
+					   "\"args\":{\"arg\":\"0x%" PRIx64 "\"}}",
+					trace_names[e->type], pid, e->tid, TS_US(e->ts), e->arg);
+			continue;
+		}
+
+		// Only one thread runs at a time: a switch ends the running slice
+		if (running >= 0)
+			fprintf(f, ",\n{\"ph\":\"X\",\"name\":\"running\",\"pid\":%d,"
+					   "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+					pid, running, TS_US(running_since),
+					TS_US(e->ts) - TS_US(running_since));
+		running = e->arg;
+		running_since = e->ts;
+		ret = trace_name_thread(f, pid, running, &seen, &nr_seen);
+	}
+	if (running >= 0)
+		fprintf(f, ",\n{\"ph\":\"X\",\"name\":\"running\",\"pid\":%d,"
+				   "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				pid, running, TS_US(running_since),
+				TS_US(end_ts) - TS_US(running_since));
+	fprintf(f, "\n]}\n");
+#undef TS_US
+
+	preempt_enable();
+
+	free(seen);
+	if (fclose(f) || ret)
+		return -1;
+	return 0;
+}
@@ -1,14 +1,20 @@
 #include <assert.h>
+#include <errno.h>
 #include <signal.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "hist.h"
+#include "pq.h"
 #include "private.h"
 #include "uthread.h"
 #include "queue.h"
+#include "sem.h"
 
 typedef enum
 {
@@ -20,24 +26,221 @@ typedef enum
 
 typedef int uthread_id;
 
+/*
+ * Timer of a thread: a sleep to end, or a deadline to cancel it at. Armed
+ * timers are in the timers priority queue of the runtime.
+ */
+struct uthread_timer
+{
+	unsigned long long when;
+	struct uthread_tcb *tcb;
+	pq_handle_t handle;
+};
+
 typedef struct uthread_tcb
 {
 	uthread_ctx_t *ctx;
 	uthread_state_t state;
 	uthread_id tid;
 	void *stack;
+	size_t stack_size;
+	unsigned int stack_flags;
+	// Stack usage measured at exit
+	bool stack_measured;
+	// Only used with UTHREAD_STACK_SHARED
+	struct uthread_shared_ctx shared;
+	// Used to wait on semaphores
+	struct sem_waiter waiter;
+	// Innermost generator being run by the thread
+	struct generator *gen;
+	// Runtime running the thread, and link in the wakeups list of another one
+	struct uthread_runtime *rt;
+	struct uthread_tcb *wake_next;
+	// Cancellation, see uthread_cancel()
+	bool cancelled;
+	// Semaphore blocked on in uthread_block_sem(), and whether that was undone
+	sem_t wait_sem;
+	bool wait_cancelled;
+	// Task group waited for in uthread_block_group()
+	struct group *wait_group;
+	struct uthread_timer sleep_timer;
+	struct uthread_timer deadline;
+	// Operations left before uthread_consume_budget() yields
+	int budget;
+	// Freed by its creator rather than when switched out of, see uthread_spawn()
+	bool owned;
+	// Thread-local storage, see uthread_key_create()
+	void *keys[UTHREAD_KEYS_INLINE];
+	void **keys_overflow;
+	int nr_keys_overflow;
+	uthread_func_t func;
+	// Node in all_threads, to leave it in O(1) when exiting
+	queue_handle_t all_node;
+	// Made ready by uthread_unblock(), rather than by creation or yielding
+	bool woken;
+	// Statistics, times are accounted for when leaving a state
+	unsigned long long state_ts;
+	unsigned long nr_scheduled;
+	unsigned long nr_voluntary;
+	unsigned long nr_preempted;
+	unsigned long long run_ns;
+	unsigned long long ready_ns;
+	unsigned long long blocked_ns;
 } uthread_tcb;
 
-uthread_tcb *curr_thd = NULL;
-uthread_tcb *placeholder_zombie = NULL;
-uthread_id next_tid = 0;
-queue_t ready_q;
-bool to_preempt = false;
+__thread struct uthread_runtime uthread_rt;
+static __thread bool stack_check;
+
+/* Thread-local storage keys, each runtime having its own */
+static __thread struct
+{
+	bool used;
+	void (*destructor)(void *);
+} keys[UTHREAD_KEYS_MAX];
+
+/* Destructor calls rounds at exit, values may be set again by destructors */
+#define KEYS_DESTRUCTOR_ROUNDS 4
 
 struct uthread_tcb *
 uthread_current(void)
 {
-	return curr_thd;
+	return uthread_rt.curr_thd;
+}
+
+int uthread_self(void)
+{
+	return uthread_rt.curr_thd ? uthread_rt.curr_thd->tid : -1;
+}
+
+unsigned long long uthread_clock_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void uthread_keys_init(uthread_tcb *tcb)
+{
+	for (int i = 0; i < UTHREAD_KEYS_INLINE; i++)
+		tcb->keys[i] = NULL;
+	tcb->keys_overflow = NULL;
+	tcb->nr_keys_overflow = 0;
+}
+
+/* Slot holding the value of @key for @tcb, NULL if it was never allocated */
+static void **uthread_key_slot(uthread_tcb *tcb, uthread_key_t key)
+{
+	if (key < UTHREAD_KEYS_INLINE)
+		return &tcb->keys[key];
+	if (key - UTHREAD_KEYS_INLINE < tcb->nr_keys_overflow)
+		return &tcb->keys_overflow[key - UTHREAD_KEYS_INLINE];
+	return NULL;
+}
+
+/* Call the destructors of the keys @tcb has values for */
+static void uthread_keys_exit(uthread_tcb *tcb)
+{
+	for (int round = 0; round < KEYS_DESTRUCTOR_ROUNDS; round++)
+	{
+		bool called = false;
+
+		for (int key = 0; key < UTHREAD_KEYS_INLINE + tcb->nr_keys_overflow;
+			 key++)
+		{
+			void **slot = uthread_key_slot(tcb, key);
+			void *value = *slot;
+
+			if (!value || !keys[key].destructor)
+				continue;
+			*slot = NULL;
+			keys[key].destructor(value);
+			called = true;
+		}
+		if (!called)
+			break;
+	}
+}
+
+static void uthread_tcb_free(uthread_tcb *tcb)
+{
+	uthread_ctx_destroy_stack(tcb->stack, tcb->stack_size, tcb->stack_flags);
+	free(tcb->keys_overflow);
+	free(tcb->ctx);
+	free(tcb);
+}
+
+int uthread_stack_overflowed(void *addr)
+{
+	uthread_tcb *tcb = uthread_rt.curr_thd;
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	if (!tcb || !(tcb->stack_flags & UTHREAD_STACK_GROWABLE))
+		return -1;
+	if ((char *)addr < (char *)tcb->stack - page ||
+		(char *)addr >= (char *)tcb->stack)
+		return -1;
+	return tcb->tid;
+}
+
+/* Shared context to switch with, if @tcb runs on the shared stack */
+static struct uthread_shared_ctx *shared_ctx(uthread_tcb *tcb)
+{
+	if (!(tcb->stack_flags & UTHREAD_STACK_SHARED) ||
+		tcb->state == UTHREAD_STATE_ZOMBIE)
+		return NULL;
+	return &tcb->shared;
+}
+
+/* Number of threads waiting to be elected, run-next slot included */
+static int ready_count(void)
+{
+	return queue_length(uthread_rt.ready_q) + (uthread_rt.run_next != NULL);
+}
+
+static void ready_enqueue(uthread_tcb *tcb)
+{
+	queue_enqueue(uthread_rt.ready_q, tcb);
+	if (ready_count() > uthread_rt.stats.run_queue_hwm)
+		uthread_rt.stats.run_queue_hwm = ready_count();
+}
+
+/* Put @tcb in the run-next slot, moving its previous occupant to the queue */
+static void ready_enqueue_next(uthread_tcb *tcb)
+{
+	uthread_tcb *prev = uthread_rt.run_next;
+
+	uthread_rt.run_next = tcb;
+	if (prev)
+		ready_enqueue(prev);
+	else if (ready_count() > uthread_rt.stats.run_queue_hwm)
+		uthread_rt.stats.run_queue_hwm = ready_count();
+}
+
+/* Take the next thread to elect, from the run-next slot if it is its turn */
+static uthread_tcb *ready_dequeue(void)
+{
+	uthread_tcb *tcb = uthread_rt.run_next;
+
+	if (tcb && uthread_rt.run_next_streak >= UTHREAD_RUN_NEXT_MAX &&
+		queue_length(uthread_rt.ready_q))
+	{
+		// Let the queue go first, the slot's thread waits in line
+		uthread_rt.run_next = NULL;
+		ready_enqueue(tcb);
+		tcb = NULL;
+	}
+	if (tcb)
+	{
+		uthread_rt.run_next = NULL;
+		uthread_rt.run_next_streak++;
+		uthread_rt.stats.nr_run_next++;
+		return tcb;
+	}
+
+	uthread_rt.run_next_streak = 0;
+	if (queue_dequeue(uthread_rt.ready_q, (void **)&tcb) == -1)
+		return NULL;
+	return tcb;
 }
 
 // Returns a shallow copy of the TCB block (allocated on heap)
@@ -51,148 +254,576 @@ uthread_tcb *clone_tcb(uthread_tcb *tcb)
 	return new_tcb;
 }
 
-void uthread_yield(void)
+/*
+ * uthread_switch - Elect the next ready thread and switch to it
+ * @preempted: Whether the current thread is being forced out by the timer
+ */
+static void uthread_switch(bool preempted)
 {
-	fprintf(stderr, "uthread_yield called! for %d thread_id\n", uthread_current());
 	uthread_tcb *old_curr = uthread_current();
+	uthread_tcb *first_ready;
+
+	// Before touching its state, which the timer handler would switch out of
+	if (uthread_rt.to_preempt)
+		preempt_disable();
 
 	// If the current thread has still not finished, we need to add it to the ready queue.
 	if (old_curr->state == UTHREAD_STATE_RUNNING)
 		old_curr->state = UTHREAD_STATE_READY;
 
-	uthread_tcb *first_ready = NULL;
-
-	if (to_preempt)
-		preempt_disable();
-
-	if (queue_dequeue(ready_q, (void **)&first_ready) == -1)
+	first_ready = ready_dequeue();
+	if (!first_ready)
+	{
+		preempt_enable();
 		return;
+	}
 
 	assert(first_ready->state == UTHREAD_STATE_READY);
 	first_ready->state = UTHREAD_STATE_RUNNING;
-	curr_thd = first_ready;
+	first_ready->budget = UTHREAD_YIELD_BUDGET;
+	uthread_rt.curr_thd = first_ready;
+
+	unsigned long long now = uthread_clock_ns();
+	old_curr->run_ns += now - old_curr->state_ts;
+	old_curr->state_ts = now;
+	if (preempted)
+		old_curr->nr_preempted++;
+	else
+		old_curr->nr_voluntary++;
+	unsigned long long delay = now - first_ready->state_ts;
+	first_ready->ready_ns += delay;
+	first_ready->state_ts = now;
+	hist_record(&uthread_rt.latency_hists[UTHREAD_LATENCY_READY], delay);
+	if (first_ready->woken)
+	{
+		hist_record(&uthread_rt.latency_hists[UTHREAD_LATENCY_WAKEUP], delay);
+		first_ready->woken = false;
+	}
+	first_ready->nr_scheduled++;
+	uthread_rt.stats.nr_switches++;
+	TRACE(TRACE_SWITCH, old_curr->tid, first_ready->tid);
 
 	// If the old thread was ready, we need to add it to the ready queue.
 	if (old_curr->state == UTHREAD_STATE_READY)
-		queue_enqueue(ready_q, old_curr);
+		ready_enqueue(old_curr);
 
 	// Earlier zombie threads were not actually being freed, leading to a memory leak.
 	// the problem was the threads were context switching before the cleanup could happen
 	// (before this if-block)
 	// If the old thread was a zombie, we need to kill it and prevent the apocalypse.
-	if (old_curr->state == UTHREAD_STATE_ZOMBIE)
+	if (old_curr->state == UTHREAD_STATE_ZOMBIE && !old_curr->owned)
 	{
-		fprintf(stderr, "Zombie found!\n");
-		if (placeholder_zombie != NULL)
-		{
-			uthread_ctx_destroy_stack(placeholder_zombie->stack);
-			// fprintf(stderr, "Destroyed stack!");
-			free(placeholder_zombie->ctx);
-			// fprintf(stderr, "Destroyed context!");
-			free(placeholder_zombie);
-			// fprintf(stderr, "Destroyed thread!");
-		}
-		placeholder_zombie = old_curr;
+		if (uthread_rt.placeholder_zombie != NULL)
+			uthread_tcb_free(uthread_rt.placeholder_zombie);
+		uthread_rt.placeholder_zombie = old_curr;
 	}
+
+	/*
+	 * Preemption stays disabled until the switch is over, the timer handler
+	 * would otherwise save the old thread in the context of the new one. It is
+	 * enabled back once this thread is switched back to, or by
+	 * uthread_ctx_bootstrap() for a new thread.
+	 */
+	if (!((old_curr->stack_flags | first_ready->stack_flags) &
+		  UTHREAD_STACK_SHARED))
+		uthread_ctx_switch(old_curr->ctx, first_ready->ctx);
+	else
+		uthread_ctx_switch_shared(old_curr->ctx, shared_ctx(old_curr),
+								  first_ready->ctx, shared_ctx(first_ready));
 	preempt_enable();
-	uthread_ctx_switch(old_curr->ctx, first_ready->ctx);
+}
+
+void uthread_yield(void)
+{
+	uthread_switch(false);
+}
+
+void uthread_preempt(void)
+{
+	if (!uthread_rt.to_preempt || !uthread_rt.curr_thd ||
+		uthread_rt.curr_thd == uthread_rt.idle_thd)
+		return;
+	uthread_switch(true);
+}
+
+void uthread_consume_budget(void)
+{
+	uthread_tcb *curr = uthread_rt.curr_thd;
+
+	if (!curr || --curr->budget > 0)
+		return;
+
+	curr->budget = UTHREAD_YIELD_BUDGET;
+	if (ready_count())
+	{
+		uthread_rt.stats.nr_budget_yields++;
+		uthread_yield();
+	}
+}
+
+/*
+ * Timers
+ */
+static int timer_cmp(const void *a, const void *b)
+{
+	const struct uthread_timer *x = a, *y = b;
+
+	return (x->when > y->when) - (x->when < y->when);
+}
+
+static int timer_arm(struct uthread_timer *timer, unsigned long long when)
+{
+	timer->when = when;
+	return pq_insert(uthread_rt.timers, timer, &timer->handle);
+}
+
+static void timer_disarm(struct uthread_timer *timer)
+{
+	if (!timer->handle)
+		return;
+	pq_remove_handle(uthread_rt.timers, timer->handle);
+	timer->handle = NULL;
+}
+
+/*
+ * uthread_poll_timers - Fire the timers that expired
+ *
+ * Return: Nanoseconds until the next timer expires, -1 if none is armed
+ */
+static long long uthread_poll_timers(void)
+{
+	struct uthread_timer *timer;
+	unsigned long long now;
+
+	if (!pq_length(uthread_rt.timers))
+		return -1;
+
+	now = uthread_clock_ns();
+	while (pq_peek(uthread_rt.timers, (void **)&timer) == 0)
+	{
+		if (timer->when > now)
+			return timer->when - now;
+		pq_extract_min(uthread_rt.timers, (void **)&timer);
+		timer->handle = NULL;
+		if (timer == &timer->tcb->deadline)
+			uthread_cancel_tcb(timer->tcb);
+		else
+			uthread_unblock(timer->tcb);
+	}
+	return -1;
 }
 
 void uthread_exit(void)
 {
 	uthread_tcb *old_curr = uthread_current();
+
+	uthread_keys_exit(old_curr);
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	queue_remove_handle(uthread_rt.all_threads, old_curr->all_node);
+	timer_disarm(&old_curr->deadline);
+	uthread_rt.stats.nr_exited++;
+	if (old_curr->stack_flags & UTHREAD_STACK_SHARED)
+		uthread_ctx_shared_exit(&old_curr->shared);
+	if (old_curr->stack_measured)
+		stack_usage_record(old_curr->func, old_curr->stack_size,
+						   uthread_ctx_stack_used(old_curr->stack,
+												  old_curr->stack_size,
+												  old_curr->stack_flags));
+	TRACE(TRACE_EXIT, old_curr->tid, 0);
+	preempt_enable();
+
 	old_curr->state = UTHREAD_STATE_ZOMBIE;
 	uthread_yield();
 }
 
+/* Hand @tcb over to its runtime, which unblocks it in uthread_poll_wakeups() */
+static void uthread_unblock_remote(uthread_tcb *tcb)
+{
+	struct uthread_runtime *rt = tcb->rt;
+
+	runtime_pin(rt);
+	tcb->wake_next = __atomic_load_n(&rt->wakeups, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&rt->wakeups, &tcb->wake_next, tcb,
+										true, __ATOMIC_SEQ_CST,
+										__ATOMIC_RELAXED))
+		;
+	runtime_ring(rt);
+	runtime_unpin(rt);
+}
+
+void uthread_poll_wakeups(void)
+{
+	uthread_tcb *tcb, *fifo = NULL;
+
+	if (!__atomic_load_n(&uthread_rt.wakeups, __ATOMIC_RELAXED))
+		return;
+
+	tcb = __atomic_exchange_n(&uthread_rt.wakeups, NULL, __ATOMIC_ACQUIRE);
+	while (tcb)
+	{
+		uthread_tcb *next = tcb->wake_next;
+
+		tcb->wake_next = fifo;
+		fifo = tcb;
+		tcb = next;
+	}
+
+	while (fifo)
+	{
+		tcb = fifo;
+		fifo = tcb->wake_next;
+		uthread_unblock(tcb);
+	}
+}
+
+static void uthread_waiter_wake(struct sem_waiter *waiter)
+{
+	uthread_tcb *tcb = waiter->data;
+
+	if (tcb->rt == &uthread_rt)
+		uthread_unblock(tcb);
+	else
+		uthread_unblock_remote(tcb);
+}
+
+uthread_ctx_t *uthread_ctx_borrow(uthread_ctx_t *ctx)
+{
+	uthread_ctx_t *old;
+
+	if (!uthread_rt.curr_thd)
+		return NULL;
+	old = uthread_rt.curr_thd->ctx;
+	uthread_rt.curr_thd->ctx = ctx;
+	return old;
+}
+
+struct generator *uthread_generator(void)
+{
+	return uthread_rt.curr_thd->gen;
+}
+
+void uthread_set_generator(struct generator *gen)
+{
+	uthread_rt.curr_thd->gen = gen;
+}
+
+struct sem_waiter *uthread_waiter(void)
+{
+	return &uthread_rt.curr_thd->waiter;
+}
+
+static void uthread_cancel_init(uthread_tcb *tcb)
+{
+	tcb->cancelled = false;
+	tcb->wait_sem = NULL;
+	tcb->wait_cancelled = false;
+	tcb->wait_group = NULL;
+	tcb->sleep_timer.tcb = tcb;
+	tcb->sleep_timer.handle = NULL;
+	tcb->deadline.tcb = tcb;
+	tcb->deadline.handle = NULL;
+}
+
+static void uthread_stats_init(uthread_tcb *tcb)
+{
+	tcb->state_ts = uthread_clock_ns();
+	tcb->woken = false;
+	tcb->nr_scheduled = 0;
+	tcb->nr_voluntary = 0;
+	tcb->nr_preempted = 0;
+	tcb->run_ns = 0;
+	tcb->ready_ns = 0;
+	tcb->blocked_ns = 0;
+}
+
+int uthread_attr_init(uthread_attr_t *attr)
+{
+	if (!attr)
+		return -1;
+
+	attr->stack_size = 0;
+	attr->stack_flags = 0;
+	return 0;
+}
+
+void uthread_stack_check(bool enable)
+{
+	stack_check = enable;
+}
+
 int uthread_create(uthread_func_t func, void *arg)
 {
+	return uthread_create_attr(func, arg, NULL, NULL);
+}
+
+/* Create a thread, made ready to run, and return its TCB */
+static uthread_tcb *uthread_create_tcb(uthread_func_t func, void *arg,
+									   const uthread_attr_t *attr, bool owned,
+									   int *tid)
+{
+	unsigned int stack_flags = attr ? attr->stack_flags : 0;
+	size_t stack_size = stack_flags & UTHREAD_STACK_GROWABLE ?
+		UTHREAD_STACK_RESERVE : UTHREAD_STACK_SIZE;
+	int ret;
+
+	if (attr && attr->stack_size)
+		stack_size = attr->stack_size;
+	if (stack_flags & UTHREAD_STACK_SHARED)
+	{
+		if (stack_flags & UTHREAD_STACK_GROWABLE)
+			return NULL;
+		stack_size = UTHREAD_SHARED_STACK_SIZE;
+	}
+	if (stack_size < UTHREAD_STACK_MIN)
+		return NULL;
+	if (stack_flags & UTHREAD_STACK_GROWABLE && stack_guard_install() == -1)
+		return NULL;
+
 	uthread_tcb *new_thd = malloc(sizeof(uthread_tcb));
 	if (!new_thd)
-		return -1;
+		return NULL;
 
 	new_thd->ctx = malloc(sizeof(uthread_ctx_t));
 	if (!new_thd->ctx)
 	{
 		free(new_thd);
-		return -1;
+		return NULL;
 	}
 
-	new_thd->stack = uthread_ctx_alloc_stack();
-	if (!new_thd->stack)
+	if (stack_flags & UTHREAD_STACK_SHARED)
+		new_thd->stack = NULL;
+	else
+		new_thd->stack = uthread_ctx_alloc_stack(stack_size, stack_flags);
+	if (!new_thd->stack && !(stack_flags & UTHREAD_STACK_SHARED))
 	{
 		free(new_thd->ctx);
 		free(new_thd);
-		return -1;
+		return NULL;
 	}
+	new_thd->stack_size = stack_size;
+	new_thd->stack_flags = stack_flags;
+	// Shared stacks are left out, they are better measured by their copies
+	new_thd->stack_measured = stack_check &&
+		!(stack_flags & UTHREAD_STACK_SHARED);
+	if (new_thd->stack_measured && !(stack_flags & UTHREAD_STACK_GROWABLE))
+		uthread_ctx_paint_stack(new_thd->stack, stack_size);
 
 	new_thd->state = UTHREAD_STATE_READY;
+	new_thd->func = func;
+	new_thd->waiter.wake = uthread_waiter_wake;
+	new_thd->waiter.data = new_thd;
+	new_thd->waiter.node = NULL;
+	new_thd->gen = NULL;
+	new_thd->rt = &uthread_rt;
+	new_thd->budget = UTHREAD_YIELD_BUDGET;
+	new_thd->owned = owned;
+	uthread_cancel_init(new_thd);
+	uthread_keys_init(new_thd);
+	uthread_stats_init(new_thd);
 
 	// If two threads are created at the same time, we need to make sure that they have different thread IDs.
-	if (to_preempt)
+	if (uthread_rt.to_preempt)
 		preempt_disable();
-	new_thd->tid = next_tid++;
+	new_thd->tid = uthread_rt.next_tid++;
 
-	if (uthread_ctx_init(new_thd->ctx, new_thd->stack, func, arg) == -1)
+	if (stack_flags & UTHREAD_STACK_SHARED)
+		ret = uthread_ctx_shared_init(&new_thd->shared, new_thd->ctx, func,
+									  arg);
+	else
+		ret = uthread_ctx_init(new_thd->ctx, new_thd->stack, stack_size, func,
+							   arg);
+	if (ret == -1 ||
+		queue_enqueue_handle(uthread_rt.all_threads, new_thd, &new_thd->all_node) == -1)
 	{
-		uthread_ctx_destroy_stack(new_thd->stack);
-		free(new_thd->ctx);
-		free(new_thd);
-		return -1;
+		preempt_enable();
+		uthread_tcb_free(new_thd);
+		return NULL;
 	}
 
-	queue_enqueue(ready_q, new_thd);
+	ready_enqueue(new_thd);
+	uthread_rt.stats.nr_created++;
+	TRACE(TRACE_CREATE, uthread_self(), new_thd->tid);
+	if (tid)
+		*tid = new_thd->tid;
 
 	preempt_enable();
 
-	return 0;
+	return new_thd;
+}
+
+int uthread_create_attr(uthread_func_t func, void *arg,
+						const uthread_attr_t *attr, int *tid)
+{
+	return uthread_create_tcb(func, arg, attr, false, tid) ? 0 : -1;
+}
+
+uthread_t uthread_create_handle(uthread_func_t func, void *arg,
+								const uthread_attr_t *attr)
+{
+	return uthread_create_tcb(func, arg, attr, false, NULL);
+}
+
+struct uthread_tcb *uthread_spawn(uthread_func_t func, void *arg)
+{
+	return uthread_create_tcb(func, arg, NULL, true, NULL);
+}
+
+void uthread_reap(struct uthread_tcb *tcb)
+{
+	assert(tcb->owned && tcb->state == UTHREAD_STATE_ZOMBIE);
+	uthread_tcb_free(tcb);
+}
+
+/*
+ * uthread_run_abort - Undo the setup of uthread_run() when it fails
+ * @main_thd: Idle thread, or NULL if it was not allocated yet
+ *
+ * Return: -1, for uthread_run() to return
+ */
+static int uthread_run_abort(uthread_tcb *main_thd)
+{
+	if (main_thd)
+	{
+		queue_delete(uthread_rt.all_threads, main_thd);
+		free(main_thd->ctx);
+		free(main_thd);
+	}
+	queue_destroy(uthread_rt.ready_q);
+	queue_destroy(uthread_rt.all_threads);
+	pq_destroy(uthread_rt.timers);
+	uthread_rt.ready_q = NULL;
+	uthread_rt.all_threads = NULL;
+	uthread_rt.timers = NULL;
+	uthread_rt.curr_thd = NULL;
+	uthread_rt.idle_thd = NULL;
+	uthread_rt.run_start_ts = 0;
+	preempt_enable();
+	return -1;
 }
 
 int uthread_run(bool preempt, uthread_func_t func, void *arg)
 {
-	to_preempt = preempt;
-	// preempt_start(preempt);
+	if (uthread_rt.running)
+		return -1;
+
+	uthread_rt.to_preempt = preempt;
 
 	if (preempt)
 		preempt_disable();
 
-	ready_q = queue_create();
-	if (!ready_q)
-		return -1;
+	uthread_rt.ready_q = queue_create();
+	uthread_rt.all_threads = queue_create();
+	uthread_rt.timers = pq_create(timer_cmp);
+	if (!uthread_rt.ready_q || !uthread_rt.all_threads || !uthread_rt.timers)
+		return uthread_run_abort(NULL);
 
 	preempt_enable();
 
+	uthread_rt.stats = (struct uthread_stats){0};
+	uthread_rt.run_start_ts = uthread_clock_ns();
+	for (int i = 0; i < UTHREAD_LATENCY_MAX; i++)
+		hist_reset(&uthread_rt.latency_hists[i]);
+
 	uthread_tcb *main_thd = malloc(sizeof(uthread_tcb));
 	if (!main_thd)
-		return -1;
+		return uthread_run_abort(NULL);
 	main_thd->ctx = malloc(sizeof(uthread_ctx_t));
 	if (!main_thd->ctx)
-	{
-		free(main_thd);
-		return -1;
-	}
+		return uthread_run_abort(main_thd);
 	main_thd->state = UTHREAD_STATE_RUNNING;
-	main_thd->tid = next_tid++;
+	main_thd->tid = uthread_rt.next_tid++;
+	main_thd->stack = NULL;
+	main_thd->stack_size = 0;
+	main_thd->stack_flags = 0;
+	main_thd->stack_measured = false;
+	main_thd->func = NULL;
+	main_thd->waiter.wake = uthread_waiter_wake;
+	main_thd->waiter.data = main_thd;
+	main_thd->waiter.node = NULL;
+	main_thd->gen = NULL;
+	main_thd->rt = &uthread_rt;
+	main_thd->budget = UTHREAD_YIELD_BUDGET;
+	main_thd->owned = false;
+	uthread_cancel_init(main_thd);
+	uthread_keys_init(main_thd);
+	uthread_stats_init(main_thd);
+	main_thd->nr_scheduled = 1;
+	if (queue_enqueue_handle(uthread_rt.all_threads, main_thd,
+							 &main_thd->all_node) == -1)
+		return uthread_run_abort(main_thd);
 
-	curr_thd = main_thd;
+	uthread_rt.curr_thd = main_thd;
+	uthread_rt.idle_thd = main_thd;
+	trace_idle(main_thd->tid);
+	uthread_rt.run_next = NULL;
+	uthread_rt.run_next_streak = 0;
 
+	if (runtime_start())
+		return uthread_run_abort(main_thd);
 	if (uthread_create(func, arg) == -1)
-		return -1;
+	{
+		runtime_stop();
+		return uthread_run_abort(main_thd);
+	}
+	preempt_start(preempt);
 
-	while (queue_length(ready_q) != 0)
-		uthread_yield();
+	/*
+	 * Check for completed offloaded functions, tasks sent by other runtimes
+	 * and expired timers at each round, and only wait for them once nothing
+	 * else is left to run
+	 */
+	for (;;)
+	{
+		long long timeout;
+		bool holds_only;
+
+		offload_poll();
+		runtime_poll();
+		uthread_poll_wakeups();
+		timeout = uthread_poll_timers();
+		if (ready_count())
+		{
+			uthread_yield();
+			continue;
+		}
+		holds_only = !uthread_rt.nr_offloads && timeout == -1;
+		if (holds_only &&
+			!__atomic_load_n(&uthread_rt.holds, __ATOMIC_ACQUIRE))
+			break;
+		runtime_wait(timeout, holds_only);
+	}
+	runtime_stop();
 
 	// Now, free the main_thread and the ready queue.
+	uthread_keys_exit(main_thd);
+	queue_remove_handle(uthread_rt.all_threads, main_thd->all_node);
+	free(main_thd->keys_overflow);
 	free(main_thd->ctx);
 	free(main_thd);
-	queue_destroy(ready_q);
+	queue_destroy(uthread_rt.ready_q);
+	// Threads still blocked at this point are never coming back
+	void *leftover;
+	while (queue_dequeue(uthread_rt.all_threads, &leftover) == 0)
+		;
+	coro_runtime_reset();
+	uthread_ctx_shared_reset();
+	stack_guard_reset();
+	queue_destroy(uthread_rt.all_threads);
+	uthread_rt.all_threads = NULL;
+	pq_destroy(uthread_rt.timers);
+	uthread_rt.timers = NULL;
+	uthread_rt.stats.elapsed_ns = uthread_clock_ns() - uthread_rt.run_start_ts;
+	uthread_rt.run_start_ts = 0;
 	// Also free the zombie thread if it exists.
-	if (placeholder_zombie != NULL)
+	if (uthread_rt.placeholder_zombie != NULL)
 	{
-		uthread_ctx_destroy_stack(placeholder_zombie->stack);
-		free(placeholder_zombie->ctx);
-		free(placeholder_zombie);
+		uthread_tcb_free(uthread_rt.placeholder_zombie);
+		uthread_rt.placeholder_zombie = NULL;
 	}
+	uthread_rt.curr_thd = NULL;
+	uthread_rt.idle_thd = NULL;
 
 	// At the end after all the multithreading shenanigans, we restore the alarms signals back before preemption.
 	preempt_stop();
@@ -204,14 +835,431 @@ void uthread_block(void)
 {
 	uthread_tcb *old_curr = uthread_current();
 	old_curr->state = UTHREAD_STATE_BLOCKED;
+	TRACE(TRACE_BLOCK, old_curr->tid, 0);
 	uthread_yield();
 }
 
 void uthread_unblock(struct uthread_tcb *uthread)
 {
 	uthread->state = UTHREAD_STATE_READY;
-	if (to_preempt)
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+
+	unsigned long long now = uthread_clock_ns();
+	uthread->blocked_ns += now - uthread->state_ts;
+	hist_record(&uthread_rt.latency_hists[UTHREAD_LATENCY_BLOCKED],
+				now - uthread->state_ts);
+	uthread->state_ts = now;
+	uthread->woken = true;
+	if (uthread_rt.curr_thd != uthread_rt.idle_thd)
+		ready_enqueue_next(uthread);
+	else
+		ready_enqueue(uthread);
+	TRACE(TRACE_UNBLOCK, uthread_self(), uthread->tid);
+
+	preempt_enable();
+}
+
+/* Time the threads woken by uthread_unblock_all() are unblocked at */
+static __thread unsigned long long unblock_ts;
+
+static void uthread_unblock_one(queue_t queue, void *data)
+{
+	uthread_tcb *tcb = data;
+	(void)queue;
+
+	tcb->state = UTHREAD_STATE_READY;
+	tcb->blocked_ns += unblock_ts - tcb->state_ts;
+	hist_record(&uthread_rt.latency_hists[UTHREAD_LATENCY_BLOCKED],
+				unblock_ts - tcb->state_ts);
+	tcb->state_ts = unblock_ts;
+	tcb->woken = true;
+	TRACE(TRACE_UNBLOCK, uthread_self(), tcb->tid);
+}
+
+void uthread_unblock_all(queue_t queue)
+{
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+
+	unblock_ts = uthread_clock_ns();
+	queue_iterate(queue, uthread_unblock_one);
+	uthread_rt.stats.nr_bulk_woken += queue_length(queue);
+	queue_splice(uthread_rt.ready_q, queue);
+	if (ready_count() > uthread_rt.stats.run_queue_hwm)
+		uthread_rt.stats.run_queue_hwm = ready_count();
+
+	preempt_enable();
+}
+
+/*
+ * Cancellation
+ */
+bool uthread_cancel_pending(void)
+{
+	if (!uthread_rt.curr_thd || !uthread_rt.curr_thd->cancelled)
+		return false;
+	errno = ECANCELED;
+	return true;
+}
+
+bool uthread_cancelled(void)
+{
+	return uthread_rt.curr_thd && uthread_rt.curr_thd->cancelled;
+}
+
+int uthread_block_sem(sem_t sem)
+{
+	uthread_tcb *curr = uthread_rt.curr_thd;
+
+	curr->wait_sem = sem;
+	curr->wait_cancelled = false;
+	uthread_block();
+	curr->wait_sem = NULL;
+	if (curr->wait_cancelled)
+	{
+		errno = ECANCELED;
+		return -1;
+	}
+	return 0;
+}
+
+void uthread_block_group(struct group *group)
+{
+	uthread_tcb *curr = uthread_rt.curr_thd;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	curr->wait_group = group;
+	// Cancelled since group_wait() checked, children are cancelled from now on
+	if (curr->cancelled)
+		group_cancel_children(group);
+	preempt_enable();
+	uthread_block();
+	curr->wait_group = NULL;
+}
+
+void uthread_cancel_tcb(uthread_tcb *tcb)
+{
+	tcb->cancelled = true;
+	timer_disarm(&tcb->deadline);
+	// Unblocked once the children exit, which they are told to do now
+	if (tcb->wait_group)
+	{
+		group_cancel_children(tcb->wait_group);
+		return;
+	}
+	if (tcb->state != UTHREAD_STATE_BLOCKED)
+		return;
+
+	if (tcb->sleep_timer.handle)
+		timer_disarm(&tcb->sleep_timer);
+	else if (!tcb->wait_sem || sem_cancel_wait(tcb->wait_sem, &tcb->waiter))
+		return;
+	tcb->wait_cancelled = true;
+	uthread_unblock(tcb);
+}
+
+/* Thread being looked for, and found, by uthread_find() */
+static __thread uthread_id find_tid;
+static __thread uthread_tcb *found_tcb;
+
+static void uthread_find_cb(queue_t queue, void *data)
+{
+	uthread_tcb *tcb = data;
+	(void)queue;
+
+	if (tcb->tid == find_tid)
+		found_tcb = tcb;
+}
+
+/* Look for a thread of the runtime, by identifier */
+static uthread_tcb *uthread_find(int tid)
+{
+	if (!uthread_rt.all_threads)
+		return NULL;
+	find_tid = tid;
+	found_tcb = NULL;
+	queue_iterate(uthread_rt.all_threads, uthread_find_cb);
+	return found_tcb;
+}
+
+/* Whether @tcb is a thread of the runtime that may be cancelled */
+static bool uthread_cancellable(uthread_tcb *tcb)
+{
+	return tcb && tcb != uthread_rt.idle_thd && tcb->rt == &uthread_rt;
+}
+
+int uthread_cancel_handle(uthread_t thread)
+{
+	if (!uthread_cancellable(thread))
+		return -1;
+	if (uthread_rt.to_preempt)
 		preempt_disable();
-	queue_enqueue(ready_q, uthread);
+	uthread_cancel_tcb(thread);
 	preempt_enable();
-}
\ No newline at end of file
+	return 0;
+}
+
+int uthread_cancel(int tid)
+{
+	return uthread_cancel_handle(uthread_find(tid));
+}
+
+int uthread_set_deadline_handle(uthread_t thread, unsigned long long timeout_ns)
+{
+	int ret = 0;
+
+	if (!uthread_cancellable(thread))
+		return -1;
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	timer_disarm(&thread->deadline);
+	if (timeout_ns)
+		ret = timer_arm(&thread->deadline, uthread_clock_ns() + timeout_ns);
+	preempt_enable();
+	return ret;
+}
+
+int uthread_set_deadline(int tid, unsigned long long timeout_ns)
+{
+	return uthread_set_deadline_handle(uthread_find(tid), timeout_ns);
+}
+
+int uthread_sleep(unsigned long long ns)
+{
+	uthread_tcb *curr = uthread_rt.curr_thd;
+
+	if (!curr || curr == uthread_rt.idle_thd)
+		return -1;
+	if (uthread_cancel_pending())
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	if (timer_arm(&curr->sleep_timer, uthread_clock_ns() + ns))
+	{
+		preempt_enable();
+		return -1;
+	}
+	curr->wait_cancelled = false;
+	preempt_enable();
+
+	// Unblocked by uthread_poll_timers(), from the idle thread
+	uthread_block();
+	if (curr->wait_cancelled)
+	{
+		errno = ECANCELED;
+		return -1;
+	}
+	return 0;
+}
+
+int uthread_stats(struct uthread_stats *stats)
+{
+	if (!stats)
+		return -1;
+
+	*stats = uthread_rt.stats;
+	if (uthread_rt.run_start_ts)
+		stats->elapsed_ns = uthread_clock_ns() - uthread_rt.run_start_ts;
+	if (stats->elapsed_ns)
+		stats->switches_per_sec = stats->nr_switches * 1e9 / stats->elapsed_ns;
+	if (uthread_rt.all_threads)
+	{
+		stats->nr_threads = queue_length(uthread_rt.all_threads);
+		stats->run_queue_len = ready_count();
+	}
+	else
+	{
+		stats->nr_threads = 0;
+		stats->run_queue_len = 0;
+	}
+	return 0;
+}
+
+// queue_iterate() callbacks take no context, so the snapshot goes through these
+static __thread struct uthread_thread_stats *snapshot_buf;
+static __thread int snapshot_len;
+static __thread int snapshot_count;
+static __thread unsigned long long snapshot_ts;
+
+static void thread_stats_snapshot(queue_t queue, void *data)
+{
+	uthread_tcb *tcb = data;
+	(void)queue;
+
+	if (snapshot_count >= snapshot_len)
+		return;
+
+	struct uthread_thread_stats *ts = &snapshot_buf[snapshot_count++];
+	unsigned long long pending = snapshot_ts - tcb->state_ts;
+	ts->tid = tcb->tid;
+	ts->func = tcb->func;
+	ts->nr_scheduled = tcb->nr_scheduled;
+	ts->nr_voluntary = tcb->nr_voluntary;
+	ts->nr_preempted = tcb->nr_preempted;
+	// Include the time spent in the current state so far
+	ts->run_ns = tcb->run_ns;
+	ts->ready_ns = tcb->ready_ns;
+	ts->blocked_ns = tcb->blocked_ns;
+	if (tcb->state == UTHREAD_STATE_RUNNING)
+		ts->run_ns += pending;
+	else if (tcb->state == UTHREAD_STATE_READY)
+		ts->ready_ns += pending;
+	else if (tcb->state == UTHREAD_STATE_BLOCKED)
+		ts->blocked_ns += pending;
+}
+
+int uthread_thread_stats(struct uthread_thread_stats *threads, int len)
+{
+	if (!threads || len < 0 || !uthread_rt.all_threads)
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	snapshot_buf = threads;
+	snapshot_len = len;
+	snapshot_count = 0;
+	snapshot_ts = uthread_clock_ns();
+	queue_iterate(uthread_rt.all_threads, thread_stats_snapshot);
+	preempt_enable();
+
+	return snapshot_count;
+}
+
+int uthread_latency(uthread_latency_t which, struct uthread_latency *lat)
+{
+	if ((unsigned int)which >= UTHREAD_LATENCY_MAX || !lat)
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	struct hist *h = &uthread_rt.latency_hists[which];
+	lat->count = h->count;
+	lat->min_ns = h->min;
+	lat->max_ns = h->max;
+	lat->mean_ns = h->count ? h->sum / h->count : 0;
+	lat->p50_ns = hist_percentile(h, 50);
+	lat->p90_ns = hist_percentile(h, 90);
+	lat->p99_ns = hist_percentile(h, 99);
+	lat->p999_ns = hist_percentile(h, 99.9);
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_latency_percentile(uthread_latency_t which, double percentile,
+							   unsigned long long *ns)
+{
+	if ((unsigned int)which >= UTHREAD_LATENCY_MAX || !ns ||
+		percentile < 0 || percentile > 100)
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	*ns = hist_percentile(&uthread_rt.latency_hists[which], percentile);
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_latency_reset(uthread_latency_t which)
+{
+	if ((unsigned int)which >= UTHREAD_LATENCY_MAX)
+		return -1;
+
+	if (uthread_rt.to_preempt)
+		preempt_disable();
+	hist_reset(&uthread_rt.latency_hists[which]);
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_key_create(uthread_key_t *key, void (*destructor)(void *))
+{
+	if (!key)
+		return -1;
+
+	for (int i = 0; i < UTHREAD_KEYS_MAX; i++)
+	{
+		if (keys[i].used)
+			continue;
+		keys[i].used = true;
+		keys[i].destructor = destructor;
+		*key = i;
+		return 0;
+	}
+	return -1;
+}
+
+/* Key being deleted, for uthread_key_clear() */
+static __thread uthread_key_t deleted_key;
+
+static void uthread_key_clear(queue_t queue, void *data)
+{
+	void **slot = uthread_key_slot(data, deleted_key);
+	(void)queue;
+
+	if (slot)
+		*slot = NULL;
+}
+
+int uthread_key_delete(uthread_key_t key)
+{
+	if ((unsigned int)key >= UTHREAD_KEYS_MAX || !keys[key].used)
+		return -1;
+
+	// So that the key does not come with stale values once reused
+	if (uthread_rt.all_threads)
+	{
+		deleted_key = key;
+		queue_iterate(uthread_rt.all_threads, uthread_key_clear);
+	}
+	keys[key].used = false;
+	keys[key].destructor = NULL;
+	return 0;
+}
+
+void *uthread_getspecific(uthread_key_t key)
+{
+	if (!uthread_rt.curr_thd)
+		return NULL;
+	if ((unsigned int)key < UTHREAD_KEYS_INLINE)
+		return uthread_rt.curr_thd->keys[key];
+	if ((unsigned int)key - UTHREAD_KEYS_INLINE <
+		(unsigned int)uthread_rt.curr_thd->nr_keys_overflow)
+		return uthread_rt.curr_thd->keys_overflow[key - UTHREAD_KEYS_INLINE];
+	return NULL;
+}
+
+int uthread_setspecific(uthread_key_t key, const void *value)
+{
+	uthread_tcb *curr = uthread_rt.curr_thd;
+	void **slot;
+
+	if (!curr || (unsigned int)key >= UTHREAD_KEYS_MAX || !keys[key].used)
+		return -1;
+
+	slot = uthread_key_slot(curr, key);
+	if (!slot)
+	{
+		// Grow the table to the next power of two holding the key
+		int len = curr->nr_keys_overflow ? curr->nr_keys_overflow : 8;
+		void **table;
+
+		while (len <= key - UTHREAD_KEYS_INLINE)
+			len *= 2;
+		table = realloc(curr->keys_overflow, len * sizeof(*table));
+		if (!table)
+			return -1;
+		for (int i = curr->nr_keys_overflow; i < len; i++)
+			table[i] = NULL;
+		curr->keys_overflow = table;
+		curr->nr_keys_overflow = len;
+		slot = uthread_key_slot(curr, key);
+	}
+	*slot = (void *)value;
+	return 0;
+}
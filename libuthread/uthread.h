@@ -2,6 +2,7 @@
 #define _UTHREAD_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /*
  * uthread_func_t - Thread function type
@@ -15,17 +16,146 @@ typedef void (*uthread_func_t)(void *arg);
  * @func: Function of the first thread to start
  * @arg: Argument to be passed to the first thread
  *
- * This function should only be called by the process' original execution
- * thread. It starts the multithreading scheduling library, and becomes the
- * "idle" thread. It returns once all the threads have finished running.
+ * This function starts the multithreading scheduling library on the calling
+ * kernel thread, and becomes the "idle" thread. It returns once all the threads
+ * have finished running, and the runtime holds taken with
+ * uthread_runtime_hold() have been released.
  *
- * If @preempt is `true`, then preemptive scheduling is enabled.
+ * Each kernel thread calling uthread_run() gets its own runtime: its threads,
+ * statistics and traces are separate from those of the other kernel threads,
+ * and all the functions of the library apply to the runtime of the calling
+ * kernel thread. Work moves from a runtime to another with uthread_send().
+ *
+ * If @preempt is `true`, then preemptive scheduling is enabled: a timer
+ * signal, firing every 10 ms of CPU time of the process, forces the running
+ * thread to yield. Threads can then be interrupted anywhere outside of the
+ * library, including in functions that are not async-signal-safe, such as
+ * malloc() or printf(), which threads of a preemptive runtime should not call
+ * concurrently.
  *
  * Return: 0 in case of success, -1 in case of failure (e.g., memory allocation,
- * context creation).
+ * context creation) or if the calling kernel thread is already in
+ * uthread_run().
  */
 int uthread_run(bool preempt, uthread_func_t func, void *arg);
 
+/*
+ * uthread_runtime_t - Runtime of a kernel thread
+ */
+typedef struct uthread_runtime *uthread_runtime_t;
+
+/*
+ * uthread_runtime_attr_t - Runtime attributes
+ * @cpu: CPU to pin the kernel thread to while it runs the runtime, or -1 to
+ *	leave it wherever the kernel schedules it
+ *
+ * Always initialize attributes with uthread_runtime_attr_init() before
+ * setting the fields of interest, so that fields added later get their
+ * default value.
+ */
+typedef struct uthread_runtime_attr {
+	int cpu;
+} uthread_runtime_attr_t;
+
+/*
+ * uthread_runtime_attr_init - Initialize runtime attributes to their defaults
+ * @attr: Attributes to initialize
+ *
+ * Return: -1 if @attr is NULL, 0 otherwise.
+ */
+int uthread_runtime_attr_init(uthread_runtime_attr_t *attr);
+
+/*
+ * uthread_run_attr - Run the multithreading library with runtime attributes
+ * @preempt: Preemption enable
+ * @func: Function of the first thread to start
+ * @arg: Argument to be passed to the first thread
+ * @attr: Runtime attributes, or NULL for the defaults
+ *
+ * Same as uthread_run(). With a CPU in @attr, the calling kernel thread is
+ * pinned to that CPU, and its memory allocations (stacks, TCBs, queues) are
+ * preferably placed on the NUMA node of that CPU, for as long as the runtime
+ * runs. The previous affinity and memory policy of the kernel thread are put
+ * back when returning.
+ *
+ * Return: -1 if the CPU of @attr does not exist or cannot be used, or in case
+ * of failure of uthread_run(). 0 otherwise.
+ */
+int uthread_run_attr(bool preempt, uthread_func_t func, void *arg,
+					 const uthread_runtime_attr_t *attr);
+
+/*
+ * uthread_runtime_cpu - Get the CPU a runtime is pinned to
+ * @rt: Runtime to look at
+ *
+ * Return: CPU given to uthread_run_attr(), -1 if @rt is NULL or not pinned.
+ */
+int uthread_runtime_cpu(uthread_runtime_t rt);
+
+/*
+ * uthread_runtime_node - Get the NUMA node a runtime runs on
+ * @rt: Runtime to look at
+ *
+ * Runtimes on the same node share their memory at the lowest cost, so work
+ * moves between them preferably.
+ *
+ * Return: Node of the CPU @rt is pinned to, -1 if @rt is NULL or not pinned.
+ */
+int uthread_runtime_node(uthread_runtime_t rt);
+
+/*
+ * uthread_runtime_self - Get the runtime of the calling kernel thread
+ *
+ * Return: Runtime of the calling kernel thread, NULL if called from outside of
+ * uthread_run().
+ */
+uthread_runtime_t uthread_runtime_self(void);
+
+/*
+ * uthread_runtime_hold - Keep the runtime of the calling kernel thread alive
+ *
+ * A held runtime does not return from uthread_run() when it runs out of
+ * threads, but waits for work sent by other kernel threads instead. Each hold
+ * is dropped with uthread_runtime_release(), possibly from another kernel
+ * thread.
+ *
+ * Return: Runtime of the calling kernel thread, NULL if called from outside of
+ * uthread_run().
+ */
+uthread_runtime_t uthread_runtime_hold(void);
+
+/*
+ * uthread_runtime_release - Drop a hold on a runtime
+ * @rt: Runtime returned by uthread_runtime_hold()
+ *
+ * Can be called from any kernel thread. Once its last hold is dropped, @rt
+ * returns from uthread_run() as soon as it runs out of threads.
+ */
+void uthread_runtime_release(uthread_runtime_t rt);
+
+/*
+ * uthread_send - Create a thread in another runtime
+ * @rt: Runtime in which to create the thread
+ * @func: Function to be executed by the thread
+ * @arg: Argument to be passed to the thread
+ *
+ * Can be called from any kernel thread, as long as @rt is held so that it
+ * cannot return from uthread_run() before the thread is created. Messages are
+ * passed through a lock-free list, and the target kernel thread is only woken
+ * up if it sleeps for lack of work.
+ *
+ * Return: -1 if @rt or @func is NULL, or in case of memory allocation failure.
+ * 0 otherwise.
+ */
+int uthread_send(uthread_runtime_t rt, uthread_func_t func, void *arg);
+
+/*
+ * uthread_nr_runtimes - Get the number of runtimes currently running
+ *
+ * Return: Number of kernel threads in uthread_run()
+ */
+int uthread_nr_runtimes(void);
+
 /*
  * uthread_create - Create a new thread
  * @func: Function to be executed by the thread
@@ -39,6 +169,104 @@ int uthread_run(bool preempt, uthread_func_t func, void *arg);
  */
 int uthread_create(uthread_func_t func, void *arg);
 
+/*
+ * UTHREAD_STACK_MIN - Smallest stack size accepted for a thread (in bytes)
+ */
+#define UTHREAD_STACK_MIN 8192
+
+/*
+ * UTHREAD_STACK_RESERVE - Default size of growable stacks (in bytes)
+ */
+#define UTHREAD_STACK_RESERVE (8 * 1024 * 1024)
+
+/*
+ * UTHREAD_STACK_GROWABLE - Give the thread a growable stack
+ *
+ * The stack is only reserved in the address space, and memory is committed
+ * page by page as the thread goes deeper: a thread that stays shallow only
+ * costs a page or two however large its stack. An inaccessible guard page
+ * below the stack turns overflows into a crash reporting the thread's
+ * identifier, instead of silent corruption of neighbouring memory.
+ */
+#define UTHREAD_STACK_GROWABLE 0x1
+
+/*
+ * UTHREAD_STACK_SHARED - Run the thread on the shared stack
+ *
+ * All the threads created with this flag run on the same 256 KiB stack. When
+ * another of them needs it, the live part of the stack of the thread leaving
+ * it is copied to the heap, in a buffer sized to the actual depth of that
+ * thread, and copied back before it runs again. Parked threads thus cost
+ * memory in proportion to how deep they are, at the price of a copy on
+ * switches between such threads. The stack size is ignored, and addresses of
+ * variables on the stack of these threads must not be handed to other threads.
+ * Cannot be combined with UTHREAD_STACK_GROWABLE.
+ */
+#define UTHREAD_STACK_SHARED 0x2
+
+/*
+ * uthread_attr_t - Thread creation attributes
+ * @stack_size: Size of the thread's stack in bytes, 0 for the default size
+ *	(UTHREAD_STACK_RESERVE for growable stacks, 32 KiB otherwise)
+ * @stack_flags: UTHREAD_STACK_* flags
+ *
+ * Always initialize attributes with uthread_attr_init() before setting the
+ * fields of interest, so that fields added later get their default value.
+ */
+typedef struct uthread_attr {
+	size_t stack_size;
+	unsigned int stack_flags;
+} uthread_attr_t;
+
+/*
+ * uthread_attr_init - Initialize thread creation attributes to their defaults
+ * @attr: Attributes to initialize
+ *
+ * Return: -1 if @attr is NULL, 0 otherwise.
+ */
+int uthread_attr_init(uthread_attr_t *attr);
+
+/*
+ * uthread_create_attr - Create a new thread with specific attributes
+ * @func: Function to be executed by the thread
+ * @arg: Argument to be passed to the thread
+ * @attr: Creation attributes, or NULL for the defaults
+ * @tid: Address where to store the identifier of the new thread, or NULL
+ *
+ * Same as uthread_create(), with the thread's stack size and other properties
+ * taken from @attr.
+ *
+ * Return: 0 in case of success, -1 in case of failure (e.g., memory allocation,
+ * context creation, stack size smaller than UTHREAD_STACK_MIN, incompatible
+ * stack flags).
+ */
+int uthread_create_attr(uthread_func_t func, void *arg,
+						const uthread_attr_t *attr, int *tid);
+
+/*
+ * uthread_t - Thread handle
+ *
+ * Refers to a thread directly, where functions given a thread identifier have
+ * to look it up among all the threads of the runtime first. A handle is only
+ * valid until its thread exits, and only in the runtime of the thread.
+ */
+typedef struct uthread_tcb *uthread_t;
+
+/*
+ * uthread_create_handle - Create a new thread and get a handle on it
+ * @func: Function to be executed by the thread
+ * @arg: Argument to be passed to the thread
+ * @attr: Creation attributes, or NULL for the defaults
+ *
+ * Same as uthread_create_attr(), returning a handle on the new thread instead
+ * of its identifier.
+ *
+ * Return: Handle on the new thread, or NULL in case of failure (see
+ * uthread_create_attr())
+ */
+uthread_t uthread_create_handle(uthread_func_t func, void *arg,
+								const uthread_attr_t *attr);
+
 /*
  * uthread_yield - Yield execution
  *
@@ -57,4 +285,437 @@ void uthread_yield(void);
  */
 void uthread_exit(void);
 
+/*
+ * UTHREAD_OFFLOAD_THREADS - Maximum number of kernel threads running offloaded
+ * functions
+ */
+#define UTHREAD_OFFLOAD_THREADS 8
+
+/*
+ * uthread_offload - Run a blocking function on a kernel thread
+ * @func: Function to run
+ * @arg: Argument to be passed to @func
+ * @result: Address where to store the value returned by @func, or NULL
+ *
+ * Block the calling thread while @func runs on a pool of kernel threads, so
+ * that a blocking system call or a long computation in @func does not stall the
+ * other threads. The pool grows on demand up to UTHREAD_OFFLOAD_THREADS kernel
+ * threads, further calls waiting for one of them to be available. @func must
+ * not call any function of the library.
+ *
+ * Return: -1 if @func is NULL, if not called from a thread, or in case of
+ * failure when starting the pool. -1 with errno set to ECANCELED, without
+ * running @func, if the thread was cancelled. 0 otherwise.
+ */
+int uthread_offload(void *(*func)(void *), void *arg, void **result);
+
+/*
+ * UTHREAD_KEYS_MAX - Maximum number of thread-local storage keys
+ */
+#define UTHREAD_KEYS_MAX 1024
+
+/*
+ * UTHREAD_KEYS_INLINE - Number of keys whose values are stored in the TCB
+ *
+ * The values of the first keys created live in the TCB itself; those of the
+ * others in a table allocated the first time a thread sets one of them.
+ */
+#define UTHREAD_KEYS_INLINE 8
+
+/*
+ * uthread_key_t - Thread-local storage key
+ */
+typedef int uthread_key_t;
+
+/*
+ * uthread_key_create - Create a thread-local storage key
+ * @key: Address where to store the new key
+ * @destructor: Function called with the value of the key of each thread
+ *	exiting with a non-NULL value, or NULL
+ *
+ * Each thread has its own value for the key, NULL until it sets it. Keys belong
+ * to the runtime of the calling kernel thread, and are allocated lowest first,
+ * so the first UTHREAD_KEYS_INLINE keys created are the fastest ones.
+ *
+ * Return: -1 if @key is NULL or if UTHREAD_KEYS_MAX keys already exist. 0
+ * otherwise.
+ */
+int uthread_key_create(uthread_key_t *key, void (*destructor)(void *));
+
+/*
+ * uthread_key_delete - Delete a thread-local storage key
+ * @key: Key to delete
+ *
+ * The values of the key are forgotten, without calling its destructor.
+ *
+ * Return: -1 if @key does not exist. 0 otherwise.
+ */
+int uthread_key_delete(uthread_key_t key);
+
+/*
+ * uthread_getspecific - Get the value of a key for the running thread
+ * @key: Key
+ *
+ * Return: Value of @key for the running thread. NULL if it was not set, if
+ * @key does not exist or if not called from a thread.
+ */
+void *uthread_getspecific(uthread_key_t key);
+
+/*
+ * uthread_setspecific - Set the value of a key for the running thread
+ * @key: Key
+ * @value: Value
+ *
+ * Return: -1 if @key does not exist, if not called from a thread, or in case
+ * of failure when allocating the table of values. 0 otherwise.
+ */
+int uthread_setspecific(uthread_key_t key, const void *value);
+
+/*
+ * uthread_cancel - Cancel a thread
+ * @tid: Identifier of the thread to cancel, in the runtime of the caller
+ *
+ * Cancellation is cooperative: the thread goes on running, but its waits at
+ * cancellation points fail with errno set to ECANCELED, from now on. These are
+ * sem_down(), uthread_sleep() and uthread_offload(); a thread blocked in one of
+ * the first two is woken up right away. Functions doing long computations can
+ * also check uthread_cancelled() from time to time. A thread cannot be
+ * uncancelled.
+ *
+ * Return: -1 if there is no thread @tid (or it is the idle thread). 0
+ * otherwise.
+ */
+int uthread_cancel(int tid);
+
+/*
+ * uthread_cancel_handle - Cancel a thread through its handle
+ * @thread: Handle on the thread to cancel
+ *
+ * Same as uthread_cancel(), in constant time.
+ *
+ * Return: -1 if @thread is NULL, the idle thread or a thread of another
+ * runtime. 0 otherwise.
+ */
+int uthread_cancel_handle(uthread_t thread);
+
+/*
+ * uthread_cancelled - Check whether the running thread was cancelled
+ *
+ * Return: true if the running thread was cancelled, false otherwise.
+ */
+bool uthread_cancelled(void);
+
+/*
+ * uthread_set_deadline - Cancel a thread after a while
+ * @tid: Identifier of the thread, in the runtime of the caller
+ * @timeout_ns: Time after which to cancel the thread, in nanoseconds from now,
+ *	or 0 to remove the deadline of the thread
+ *
+ * Once the deadline passes, @tid is cancelled as with uthread_cancel(). Setting
+ * a deadline replaces the previous one. While a thread with a deadline is
+ * alive, uthread_run() does not return.
+ *
+ * Return: -1 if there is no thread @tid (or it is the idle thread), or in case
+ * of memory allocation failure. 0 otherwise.
+ */
+int uthread_set_deadline(int tid, unsigned long long timeout_ns);
+
+/*
+ * uthread_set_deadline_handle - Cancel a thread after a while, through its
+ * handle
+ * @thread: Handle on the thread
+ * @timeout_ns: Time after which to cancel the thread, in nanoseconds from now,
+ *	or 0 to remove the deadline of the thread
+ *
+ * Same as uthread_set_deadline(), without looking the thread up.
+ *
+ * Return: -1 if @thread is NULL, the idle thread or a thread of another
+ * runtime, or in case of memory allocation failure. 0 otherwise.
+ */
+int uthread_set_deadline_handle(uthread_t thread, unsigned long long timeout_ns);
+
+/*
+ * uthread_sleep - Block the running thread for a while
+ * @ns: Time to sleep, in nanoseconds
+ *
+ * The other threads run in the meantime. Timers are checked by the idle thread
+ * at each scheduling round, so the sleep can last a round longer than asked.
+ *
+ * Return: -1 if not called from a thread, in case of memory allocation
+ * failure, or with errno set to ECANCELED if the thread was cancelled. 0
+ * otherwise.
+ */
+int uthread_sleep(unsigned long long ns);
+
+/*
+ * UTHREAD_YIELD_BUDGET - Number of operations a thread may complete without
+ * blocking before uthread_consume_budget() makes it yield
+ */
+#define UTHREAD_YIELD_BUDGET 128
+
+/*
+ * uthread_consume_budget - Account for an operation that did not block
+ *
+ * Every time a thread is elected, it is given a budget of UTHREAD_YIELD_BUDGET
+ * operations. Operations that may block (sem_down(), gen_next(), and wrappers
+ * of blocking calls built on the library) spend one unit of it when they
+ * complete right away instead, and the thread yields once it ran out, if
+ * another thread is ready. A thread always finding what it waits for available
+ * thus still lets the others run, without relying on preemption.
+ */
+void uthread_consume_budget(void);
+
+/*
+ * uthread_self - Get identifier of currently running thread
+ *
+ * Identifiers are given in creation order, the "idle" thread of uthread_run()
+ * being the first one. Each runtime numbers its threads on its own.
+ *
+ * Return: Identifier of the calling thread, -1 if called from outside of
+ * uthread_run().
+ */
+int uthread_self(void);
+
+/*
+ * struct uthread_stats - Runtime-wide scheduler statistics
+ * @elapsed_ns: Time since uthread_run() started (or total time of the last
+ *	run, once it returned)
+ * @nr_switches: Number of context switches
+ * @switches_per_sec: Average rate of context switches over @elapsed_ns
+ * @nr_created: Number of threads created
+ * @nr_exited: Number of threads that exited
+ * @nr_threads: Number of threads currently alive, including the idle thread
+ * @run_queue_len: Number of threads currently waiting to be scheduled
+ * @run_queue_hwm: Maximum number of threads that waited to be scheduled at the
+ *	same time
+ * @sem_contended: Number of times sem_down() found its semaphore unavailable
+ *	and had to block
+ * @nr_run_next: Number of switches to a thread that was woken last, ahead of
+ *	the ready queue
+ * @nr_budget_yields: Number of times a thread was made to yield by
+ *	uthread_consume_budget()
+ * @sem_spun: Number of times sem_down() got a semaphore released by another
+ *	runtime while spinning, without blocking
+ * @nr_bulk_woken: Number of threads woken up all at once with others, by a
+ *	wait group, barrier, latch or once-initialization
+ */
+struct uthread_stats {
+	unsigned long long elapsed_ns;
+	unsigned long long nr_switches;
+	double switches_per_sec;
+	unsigned long nr_created;
+	unsigned long nr_exited;
+	int nr_threads;
+	int run_queue_len;
+	int run_queue_hwm;
+	unsigned long sem_contended;
+	unsigned long nr_run_next;
+	unsigned long nr_budget_yields;
+	unsigned long sem_spun;
+	unsigned long nr_bulk_woken;
+};
+
+/*
+ * struct uthread_thread_stats - Per-thread scheduler statistics
+ * @tid: Thread identifier, as returned by uthread_self()
+ * @func: Function the thread was created with (NULL for the idle thread)
+ * @nr_scheduled: Number of times the thread was elected to run
+ * @nr_voluntary: Number of times the thread gave the CPU up itself (yield,
+ *	block or exit)
+ * @nr_preempted: Number of times the thread was forced out by preemption (only
+ *	in runtimes started with preemption enabled)
+ * @run_ns: Time spent running
+ * @ready_ns: Time spent ready, waiting to be elected
+ * @blocked_ns: Time spent blocked
+ */
+struct uthread_thread_stats {
+	int tid;
+	uthread_func_t func;
+	unsigned long nr_scheduled;
+	unsigned long nr_voluntary;
+	unsigned long nr_preempted;
+	unsigned long long run_ns;
+	unsigned long long ready_ns;
+	unsigned long long blocked_ns;
+};
+
+/*
+ * uthread_stats - Get a snapshot of the runtime-wide statistics
+ * @stats: Structure to fill
+ *
+ * Counters are reset each time uthread_run() starts, and are kept after it
+ * returns until the next run.
+ *
+ * Return: -1 if @stats is NULL, 0 otherwise.
+ */
+int uthread_stats(struct uthread_stats *stats);
+
+/*
+ * uthread_thread_stats - Get a snapshot of the per-thread statistics
+ * @threads: Array to fill, one entry per live thread
+ * @len: Number of entries of @threads
+ *
+ * Fill @threads with the statistics of up to @len threads currently alive
+ * (running, ready or blocked), in creation order. Time spent in the current
+ * state of each thread is included.
+ *
+ * Return: -1 if @threads is NULL, if @len is negative or if called from
+ * outside of uthread_run(). Number of entries filled otherwise.
+ */
+int uthread_thread_stats(struct uthread_thread_stats *threads, int len);
+
+/*
+ * uthread_latency_t - Scheduling latencies tracked by the runtime
+ * @UTHREAD_LATENCY_READY: Time from a thread becoming ready (created, yielding
+ *	or unblocked) to it running
+ * @UTHREAD_LATENCY_WAKEUP: Same, only for threads that were unblocked, i.e.
+ *	the delay between uthread_unblock() and the thread actually running
+ * @UTHREAD_LATENCY_BLOCKED: Time threads spend blocked
+ */
+typedef enum {
+	UTHREAD_LATENCY_READY,
+	UTHREAD_LATENCY_WAKEUP,
+	UTHREAD_LATENCY_BLOCKED,
+	UTHREAD_LATENCY_MAX,
+} uthread_latency_t;
+
+/*
+ * struct uthread_latency - Summary of a latency histogram, in nanoseconds
+ * @count: Number of recorded durations
+ * @min_ns, @max_ns, @mean_ns: Exact minimum, maximum and mean
+ * @p50_ns, @p90_ns, @p99_ns, @p999_ns: Percentiles, within about 6%
+ */
+struct uthread_latency {
+	unsigned long long count;
+	unsigned long long min_ns;
+	unsigned long long max_ns;
+	unsigned long long mean_ns;
+	unsigned long long p50_ns;
+	unsigned long long p90_ns;
+	unsigned long long p99_ns;
+	unsigned long long p999_ns;
+};
+
+/*
+ * uthread_latency - Get a summary of a latency histogram
+ * @which: Latency to summarize
+ * @lat: Structure to fill
+ *
+ * Latencies are recorded in log-linear histograms, which are reset each time
+ * uthread_run() starts or through uthread_latency_reset().
+ *
+ * Return: -1 if @which is invalid or @lat is NULL, 0 otherwise.
+ */
+int uthread_latency(uthread_latency_t which, struct uthread_latency *lat);
+
+/*
+ * uthread_latency_percentile - Get any percentile of a latency histogram
+ * @which: Latency to query
+ * @percentile: Percentile, between 0 and 100
+ * @ns: Address where the latency at @percentile is received
+ *
+ * Return: -1 if @which or @percentile are invalid or @ns is NULL, 0 otherwise.
+ */
+int uthread_latency_percentile(uthread_latency_t which, double percentile,
+							   unsigned long long *ns);
+
+/*
+ * uthread_latency_reset - Reset a latency histogram
+ * @which: Latency to reset
+ *
+ * Return: -1 if @which is invalid, 0 otherwise.
+ */
+int uthread_latency_reset(uthread_latency_t which);
+
+/*
+ * uthread_trace_start - Start recording scheduling events
+ * @nr_events: Number of events kept in memory
+ *
+ * Record thread switches, creations, exits, blocks and unblocks, and
+ * semaphore waits and wakes, in a ring buffer of @nr_events events. Once the
+ * buffer is full, the oldest events are overwritten. Starting again discards
+ * the events recorded so far.
+ *
+ * Return: -1 if @nr_events is 0 or in case of memory allocation error, 0
+ * otherwise.
+ */
+int uthread_trace_start(size_t nr_events);
+
+/*
+ * uthread_trace_stop - Stop recording scheduling events
+ *
+ * Recorded events are kept until the next uthread_trace_start(), so that they
+ * can be dumped.
+ */
+void uthread_trace_stop(void);
+
+/*
+ * uthread_trace_dump - Write the recorded events as a Chrome trace
+ * @path: Path of the file to write
+ *
+ * Write the events currently in the ring buffer to @path in the Chrome trace
+ * event JSON format, which chrome://tracing and Perfetto open. Each thread
+ * gets its own track, showing when it ran and its events. Can be called while
+ * recording or after uthread_trace_stop().
+ *
+ * Return: -1 if @path is NULL, if nothing was ever recorded or if @path could
+ * not be written. 0 otherwise.
+ */
+int uthread_trace_dump(const char *path);
+
+/*
+ * uthread_stack_check - Enable or disable stack usage measurement
+ * @enable: Whether to measure the stack usage of threads created from now on
+ *
+ * When enabled, the stacks of new threads are filled with a known pattern,
+ * and when each of these threads exits, the deepest point its stack reached is
+ * found by looking for the first overwritten byte. Measures are aggregated per
+ * thread function. Filling stacks makes thread creation slower, and commits
+ * the memory of the whole stack right away.
+ */
+void uthread_stack_check(bool enable);
+
+/*
+ * UTHREAD_STACK_USAGE_BUCKETS - Number of buckets of stack usage histograms
+ *
+ * Bucket 0 counts threads that used less than 1 KiB of stack, bucket i
+ * (i > 0) those that used from 2^(i-1) KiB to less than 2^i KiB. The last
+ * bucket also counts anything above.
+ */
+#define UTHREAD_STACK_USAGE_BUCKETS 16
+
+/*
+ * struct uthread_stack_usage - Stack usage of the threads of a function
+ * @func: Function the threads were created with
+ * @nr_threads: Number of measured threads
+ * @max_stack_size: Largest stack size these threads were given
+ * @max_used: Deepest stack usage among these threads, in bytes
+ * @hist: Histogram of the stack usage of these threads
+ */
+struct uthread_stack_usage {
+	uthread_func_t func;
+	unsigned long nr_threads;
+	size_t max_stack_size;
+	size_t max_used;
+	unsigned long hist[UTHREAD_STACK_USAGE_BUCKETS];
+};
+
+/*
+ * uthread_stack_usage - Get the stack usage measured so far
+ * @usage: Array to fill, one entry per thread function
+ * @len: Number of entries of @usage
+ *
+ * Measures accumulate across calls to uthread_run(), until
+ * uthread_stack_usage_reset().
+ *
+ * Return: -1 if @usage is NULL or @len is negative. Number of entries filled
+ * otherwise.
+ */
+int uthread_stack_usage(struct uthread_stack_usage *usage, int len);
+
+/*
+ * uthread_stack_usage_reset - Forget the stack usage measured so far
+ */
+void uthread_stack_usage_reset(void);
+
 #endif /* _THREAD_H */